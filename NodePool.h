@@ -0,0 +1,366 @@
+#ifndef S21_NODE_POOL_H_
+#define S21_NODE_POOL_H_
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+namespace s21 {
+// Bytes held by a container, as reported by memory_usage().
+struct MemoryUsage {
+  size_t node_bytes;     // slots occupied by live tree nodes
+  size_t sentinel_bytes; // the sentinel embedded in the container
+  size_t slab_overhead;  // free slots and slab bookkeeping
+  size_t payload_bytes;  // live out-of-line values (split_map)
+  size_t total() const noexcept {
+    return node_bytes + sentinel_bytes + slab_overhead + payload_bytes;
+  }
+};
+
+// Byte limit on the slabs of one container; the pools of a container share
+// it. When growth would cross the limit, on_exceeded is asked with the byte
+// count that would result; without a callback, or when it returns false,
+// the allocation fails with std::length_error.
+struct MemoryBudget {
+  MemoryBudget(size_t limit_bytes, std::function<bool(size_t)> callback)
+      : limit(limit_bytes), used(0), on_exceeded(std::move(callback)) {}
+  // trims a request for count slots of slot_size bytes to what still fits
+  size_t admit(size_t count, size_t slot_size) {
+    size_t room = used < limit ? (limit - used) / slot_size : 0;
+    if (room >= count)
+      return count;
+    if (room > 0)
+      return room;
+    if (on_exceeded && on_exceeded(used + count * slot_size))
+      return count;
+    throw std::length_error("memory budget exceeded");
+  }
+
+  size_t limit;
+  size_t used;
+  std::function<bool(size_t)> on_exceeded;
+};
+
+// Hands out fixed-size node storage from large contiguous slabs. Released
+// nodes go to an intrusive free list and are reused before the next slab is
+// requested, so a tree of n nodes costs O(log n) slab allocations instead of
+// n separate ones. Slabs and bookkeeping are obtained from Allocator; the
+// pool only hands out raw storage, constructing the node is up to the owner.
+template <typename Node, typename Allocator> class NodePool {
+  union Slot {
+    Slot *next_;
+    alignas(Node) unsigned char storage_[sizeof(Node)];
+  };
+  struct Slab {
+    Slot *slots_;
+    size_t count_;
+  };
+  using slot_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+  using slot_traits = std::allocator_traits<slot_allocator>;
+  using slab_allocator =
+      typename std::allocator_traits<Allocator>::template rebind_alloc<Slab>;
+  using slab_table = std::vector<Slab, slab_allocator>;
+  // Owner of the slabs once a node has left the pool: it lives on while
+  // any pool or node handle holds one of its nodes.
+  struct SlabStore {
+    SlabStore(const slot_allocator &alloc, slab_table &&slabs)
+        : alloc_(alloc), slabs_(std::move(slabs)) {}
+    ~SlabStore() {
+      for (auto &s : slabs_)
+        slot_traits::deallocate(alloc_, s.slots_, s.count_);
+    }
+    slot_allocator alloc_;
+    slab_table slabs_;
+    // slots of nodes dropped outside any pool; the pools holding the store
+    // take them back before they grow
+    std::atomic<Slot *> returned_{nullptr};
+  };
+  using store_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<SlabStore>;
+  using keep_alive_allocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<std::shared_ptr<SlabStore>>;
+
+public:
+  using allocator_type = Allocator;
+  using size_type = size_t;
+
+  NodePool() : NodePool(Allocator()) {}
+  explicit NodePool(const Allocator &alloc)
+      : alloc_(alloc), slabs_(slab_allocator(alloc)), free_list_(nullptr),
+        cursor_(nullptr), cursor_end_(nullptr), capacity_(0), used_(0),
+        adopted_(keep_alive_allocator(alloc)) {}
+  NodePool(const NodePool &) = delete;
+  NodePool(NodePool &&other) noexcept
+      : alloc_(std::move(other.alloc_)), slabs_(std::move(other.slabs_)),
+        budget_(std::move(other.budget_)), free_list_(other.free_list_),
+        cursor_(other.cursor_), cursor_end_(other.cursor_end_),
+        capacity_(other.capacity_), used_(other.used_),
+        store_(std::move(other.store_)), adopted_(std::move(other.adopted_)) {
+    other.slabs_.clear();
+    other.adopted_.clear();
+    other.free_list_ = other.cursor_ = other.cursor_end_ = nullptr;
+    other.capacity_ = other.used_ = 0;
+  }
+  NodePool &operator=(const NodePool &) = delete;
+  NodePool &operator=(NodePool &&) = delete;
+  ~NodePool() { release(); }
+
+  Node *allocate() { return reinterpret_cast<Node *>(take()); }
+  void deallocate(Node *node) noexcept {
+    give_back(reinterpret_cast<Slot *>(node));
+  }
+  allocator_type get_allocator() const { return allocator_type(alloc_); }
+  // slab bytes already held are charged to the new budget
+  void set_budget(std::shared_ptr<MemoryBudget> budget) {
+    if (budget_)
+      budget_->used -= capacity_ * sizeof(Slot);
+    budget_ = std::move(budget);
+    if (budget_)
+      budget_->used += capacity_ * sizeof(Slot);
+  }
+  const std::shared_ptr<MemoryBudget> &budget() const noexcept {
+    return budget_;
+  }
+  // drops every slab and adopts alloc; only valid while no node is live
+  void reset(const Allocator &alloc) {
+    release();
+    alloc_ = slot_allocator(alloc);
+    slabs_ = slab_table(slab_allocator(alloc));
+    adopted_ = std::vector<std::shared_ptr<SlabStore>, keep_alive_allocator>(
+        keep_alive_allocator(alloc));
+  }
+
+  // The slab store holding node, for whoever takes the node out of the
+  // pool to keep alive. The pool's own slabs move into a shared store the
+  // first time.
+  std::shared_ptr<void> store_of(const Node *node) {
+    const Slot *slot = reinterpret_cast<const Slot *>(node);
+    for (auto &store : adopted_) {
+      for (const Slab &s : store->slabs_)
+        if (slot >= s.slots_ && slot < s.slots_ + s.count_)
+          return store;
+    }
+    return share();
+  }
+  // keeps the store of a node about to be adopted alive with this pool
+  void adopt_slabs(const std::shared_ptr<void> &store) {
+    keep(std::static_pointer_cast<SlabStore>(store));
+  }
+  // keeps every store that nodes of donor may live in alive with this pool
+  void adopt_slabs(NodePool &donor) {
+    keep(donor.share());
+    for (auto &store : donor.adopted_)
+      keep(store);
+  }
+  // count nodes from a shared store join the pool; once deallocated their
+  // slots are reused here like any other
+  void adopt(size_type count) noexcept { used_ += count; }
+  // count live nodes leave the pool, their slots stay with the shared store
+  void disown(size_type count) noexcept { used_ -= count; }
+  // Hands the slot of a disowned node back to store, the one store_of()
+  // gave for it, once the node is destroyed. Safe from any thread.
+  static void return_slot(const std::shared_ptr<void> &store,
+                          Node *node) noexcept {
+    auto &returned = static_cast<SlabStore *>(store.get())->returned_;
+    Slot *slot = reinterpret_cast<Slot *>(node);
+    slot->next_ = returned.load(std::memory_order_relaxed);
+    while (!returned.compare_exchange_weak(slot->next_, slot,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+    }
+  }
+
+  // makes room for at least n live nodes with at most one new slab
+  void reserve(size_type n) {
+    if (n > capacity_)
+      add_slab(n - capacity_);
+  }
+  // returns every slab that holds no live node to the system
+  void shrink_to_fit() {
+    take_returned();
+    slab_table &table = slabs();
+    if (table.empty())
+      return;
+    if (used_ == 0) {
+      release();
+      return;
+    }
+    retire_cursor();
+    std::sort(table.begin(), table.end(),
+              [](const Slab &a, const Slab &b) { return a.slots_ < b.slots_; });
+    // slots adopted from other stores count under an extra last entry
+    std::vector<size_type> free_count(table.size() + 1, 0);
+    for (Slot *i = free_list_; i; i = i->next_)
+      ++free_count[slab_of(i)];
+    Slot *kept = nullptr;
+    for (Slot *i = free_list_, *next; i; i = next) {
+      next = i->next_;
+      size_type s = slab_of(i);
+      if (s == table.size() || free_count[s] != table[s].count_) {
+        i->next_ = kept;
+        kept = i;
+      }
+    }
+    free_list_ = kept;
+    size_type j = 0;
+    for (size_type s = 0; s < table.size(); ++s) {
+      if (free_count[s] == table[s].count_) {
+        free_slab(table[s]);
+      } else {
+        table[j++] = table[s];
+      }
+    }
+    table.resize(j);
+  }
+  // allocators are exchanged only when Propagate says so, as containers do
+  template <typename Propagate>
+  void swap(NodePool &other, Propagate) noexcept {
+    if constexpr (Propagate::value) {
+      using std::swap;
+      swap(alloc_, other.alloc_);
+    }
+    slabs_.swap(other.slabs_);
+    store_.swap(other.store_);
+    adopted_.swap(other.adopted_);
+    budget_.swap(other.budget_);
+    std::swap(free_list_, other.free_list_);
+    std::swap(cursor_, other.cursor_);
+    std::swap(cursor_end_, other.cursor_end_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(used_, other.used_);
+  }
+  size_type capacity() const noexcept { return capacity_; }
+  size_type size() const noexcept { return used_; }
+  size_type slab_count() const noexcept { return slabs().size(); }
+  size_type slot_size() const noexcept { return sizeof(Slot); }
+  // bytes of every slab plus the slab table
+  size_type reserved_bytes() const noexcept {
+    return capacity_ * sizeof(Slot) + slabs().capacity() * sizeof(Slab);
+  }
+  // with a shared store, slabs still holding nodes elsewhere are freed by
+  // the last owner
+  void release() noexcept {
+    if (store_) {
+      if (budget_)
+        budget_->used -= capacity_ * sizeof(Slot);
+      store_.reset();
+    }
+    for (auto &s : slabs_)
+      free_slab(s);
+    slabs_.clear();
+    adopted_.clear();
+    free_list_ = cursor_ = cursor_end_ = nullptr;
+    capacity_ = used_ = 0;
+  }
+
+private:
+  static constexpr size_type kFirstSlab = 16;
+  static constexpr size_type kMaxSlab = size_type(1) << 16;
+
+  Slot *take() {
+    if (!free_list_ && cursor_ == cursor_end_ && !take_returned())
+      add_slab(std::min(std::max(capacity_, kFirstSlab), kMaxSlab));
+    Slot *slot = free_list_;
+    if (slot)
+      free_list_ = slot->next_;
+    else
+      slot = cursor_++;
+    ++used_;
+    return slot;
+  }
+  // moves the slots returned to every store held onto the free list
+  bool take_returned() noexcept {
+    bool any = store_ && take_returned(*store_);
+    for (auto &store : adopted_)
+      any = take_returned(*store) || any;
+    return any;
+  }
+  bool take_returned(SlabStore &store) noexcept {
+    Slot *slot = store.returned_.exchange(nullptr, std::memory_order_acquire);
+    if (!slot)
+      return false;
+    while (slot) {
+      Slot *next = slot->next_;
+      slot->next_ = free_list_;
+      free_list_ = slot;
+      slot = next;
+    }
+    return true;
+  }
+  void give_back(Slot *slot) noexcept {
+    slot->next_ = free_list_;
+    free_list_ = slot;
+    --used_;
+  }
+  // moves the slabs into a shared store, once
+  const std::shared_ptr<SlabStore> &share() {
+    if (!store_)
+      store_ = std::allocate_shared<SlabStore>(store_allocator(alloc_),
+                                               alloc_, std::move(slabs_));
+    return store_;
+  }
+  void keep(const std::shared_ptr<SlabStore> &store) {
+    if (store == store_ ||
+        std::find(adopted_.begin(), adopted_.end(), store) != adopted_.end())
+      return;
+    adopted_.push_back(store);
+  }
+  slab_table &slabs() noexcept { return store_ ? store_->slabs_ : slabs_; }
+  const slab_table &slabs() const noexcept {
+    return store_ ? store_->slabs_ : slabs_;
+  }
+  void add_slab(size_type count) {
+    slab_table &table = slabs();
+    table.reserve(table.size() + 1);
+    if (budget_)
+      count = budget_->admit(count, sizeof(Slot));
+    Slot *slots = slot_traits::allocate(alloc_, count);
+    table.push_back(Slab{slots, count});
+    if (budget_)
+      budget_->used += count * sizeof(Slot);
+    retire_cursor();
+    cursor_ = slots;
+    cursor_end_ = slots + count;
+    capacity_ += count;
+  }
+  void free_slab(const Slab &slab) noexcept {
+    slot_traits::deallocate(alloc_, slab.slots_, slab.count_);
+    capacity_ -= slab.count_;
+    if (budget_)
+      budget_->used -= slab.count_ * sizeof(Slot);
+  }
+  // moves the untouched tail of the current slab onto the free list
+  void retire_cursor() noexcept {
+    for (; cursor_ != cursor_end_; ++cursor_) {
+      cursor_->next_ = free_list_;
+      free_list_ = cursor_;
+    }
+    cursor_ = cursor_end_ = nullptr;
+  }
+  // slabs must be sorted by address; slabs().size() for a foreign slot
+  size_type slab_of(const Slot *slot) const noexcept {
+    const slab_table &table = slabs();
+    auto it = std::upper_bound(
+        table.begin(), table.end(), slot,
+        [](const Slot *p, const Slab &s) { return p < s.slots_; });
+    if (it == table.begin() || slot >= (it - 1)->slots_ + (it - 1)->count_)
+      return table.size();
+    return static_cast<size_type>(it - table.begin()) - 1;
+  }
+  slot_allocator alloc_;
+  slab_table slabs_;
+  std::shared_ptr<MemoryBudget> budget_;
+  Slot *free_list_;
+  Slot *cursor_, *cursor_end_;
+  size_type capacity_;
+  size_type used_;
+  std::shared_ptr<SlabStore> store_;
+  // other pools' stores, which adopted nodes may live in
+  std::vector<std::shared_ptr<SlabStore>, keep_alive_allocator> adopted_;
+};
+} // namespace s21
+#endif // S21_NODE_POOL_H_
@@ -1,9 +1,143 @@
 #ifndef RBTREE_H_
 #define RBTREE_H_
+#include "NodePool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+#if __cplusplus > 201703L
+#include <compare>
+#endif
 namespace s21 {
-template <typename Key, typename T, typename Compare> class RBTree {
+// key extraction policies: a node holds a single value_type and the tree
+// reads the key out of it, so the key is never stored twice
+template <typename T> struct Identity {
+  const T &operator()(const T &value) const noexcept { return value; }
+};
+template <typename Pair> struct SelectFirst {
+  const typename Pair::first_type &
+  operator()(const Pair &value) const noexcept {
+    return value.first;
+  }
+};
+// Compare::is_transparent opts a comparator into lookups by any type it
+// can order against the key, so probing needs no temporary key_type
+template <typename Compare, typename = void>
+struct is_transparent : std::false_type {};
+template <typename Compare>
+struct is_transparent<Compare, std::void_t<typename Compare::is_transparent>>
+    : std::true_type {};
+// enables a container's lookup by K when Compare is transparent
+template <typename Compare, typename K>
+using transparent_key_t = std::enable_if_t<is_transparent<Compare>::value, K>;
+// enables a container's bulk lookup over a Range of Key, or of any type
+// when Compare is transparent
+template <typename Compare, typename Key, typename Range>
+using key_range_t = std::enable_if_t<
+    is_transparent<Compare>::value ||
+        std::is_same<std::decay_t<decltype(*std::begin(
+                         std::declval<const Range &>()))>,
+                     Key>::value,
+    Range>;
+// Keys that order themselves in one call: the standard strings through
+// compare(), or a class type with operator<=> when that is available. A
+// compare() member of any other type may mean something else entirely.
+// Only the stock comparators are replaced by it, since any other Compare
+// may order keys differently.
+template <typename Key> struct is_basic_string : std::false_type {};
+template <typename Char, typename Traits, typename Alloc>
+struct is_basic_string<std::basic_string<Char, Traits, Alloc>>
+    : std::true_type {};
+template <typename Char, typename Traits>
+struct is_basic_string<std::basic_string_view<Char, Traits>>
+    : std::true_type {};
+template <typename Key, typename K, typename = void>
+struct has_compare : std::false_type {};
+template <typename Key, typename K>
+struct has_compare<
+    Key, K,
+    std::enable_if_t<is_basic_string<Key>::value &&
+                     std::is_same<decltype(std::declval<const Key &>().compare(
+                                      std::declval<const K &>())),
+                                  int>::value>> : std::true_type {};
+template <typename Compare, typename Key, typename K>
+struct uses_three_way
+    : std::bool_constant<(std::is_same<Compare, std::less<Key>>::value ||
+                          std::is_same<Compare, std::less<>>::value) &&
+                         (has_compare<Key, K>::value
+#ifdef __cpp_lib_three_way_comparison
+                          || (std::is_class<Key>::value &&
+                              std::three_way_comparable_with<K, Key>)
+#endif
+                              )> {
+};
+// Opt-in ordering for string-like keys. A tree ordered by PrefixLess
+// keeps the first Bytes of every key and its length in the node, next to
+// the links, and a descent reads a key's own buffer only when two keys
+// agree on those. Ordering is that of std::string_view.
+template <size_t Bytes = 8> struct PrefixLess {
+  static_assert(Bytes == 8 || Bytes == 16, "prefix must be 8 or 16 bytes");
+  using is_transparent = void;
+  template <typename A, typename B>
+  bool operator()(const A &a, const B &b) const noexcept {
+    return std::string_view(a) < std::string_view(b);
+  }
+};
+template <typename Compare>
+struct prefix_bytes : std::integral_constant<size_t, 0> {};
+template <size_t Bytes>
+struct prefix_bytes<PrefixLess<Bytes>>
+    : std::integral_constant<size_t, Bytes> {};
+// the cached part of a key: its first Bytes, big-endian so that they
+// order as integers, and its length
+template <size_t Bytes> struct KeyPrefix {
+  void cache_prefix(std::string_view key) noexcept {
+    unsigned char bytes[Bytes] = {};
+    std::memcpy(bytes, key.data(), std::min(key.size(), Bytes));
+    for (size_t w = 0; w < Bytes / 8; ++w) {
+      words_[w] = 0;
+      for (size_t i = 0; i < 8; ++i)
+        words_[w] = words_[w] << 8 | bytes[w * 8 + i];
+    }
+    size_ = key.size();
+  }
+  // the sign of this key against other, or 0 when they are equal or both
+  // truncated and equal as far as the prefix goes
+  int order(const KeyPrefix &other) const noexcept {
+    for (size_t w = 0; w < Bytes / 8; ++w) {
+      if (words_[w] != other.words_[w])
+        return words_[w] < other.words_[w] ? -1 : 1;
+    }
+    if (truncated() && other.truncated())
+      return 0;
+    // the shorter key is a prefix of the other
+    return (size_ > other.size_) - (size_ < other.size_);
+  }
+  bool truncated() const noexcept { return size_ > Bytes; }
+
+  uint64_t words_[Bytes / 8];
+  size_t size_;
+};
+template <> struct KeyPrefix<0> {};
+// node layout produced by compact()
+enum class CompactOrder { IN_ORDER, BREADTH_FIRST };
+
+template <typename Key, typename T, typename KeyOfValue, typename Compare,
+          typename Allocator = std::allocator<T>>
+class RBTree {
 public:
   // typedefs
   using key_type = Key;
@@ -11,61 +145,62 @@ public:
   using reference = value_type &;
   using const_reference = const value_type &;
   using size_type = size_t;
+  using allocator_type = Allocator;
 
   // internal classes/structures
   enum Color : bool { BLACK = 1, RED = 0 };
-  class Node {
+  // links and colour; the sentinel is a bare NodeBase embedded in the tree.
+  // Nodes are at least pointer-aligned, so the colour lives in the low bit
+  // of the parent link and costs no extra word per node.
+  struct NodeBase {
+    NodeBase *parent() const noexcept {
+      return reinterpret_cast<NodeBase *>(parent_color_ & ~uintptr_t(1));
+    }
+    Color color() const noexcept { return Color(parent_color_ & 1); }
+    void set_parent(NodeBase *parent) noexcept {
+      parent_color_ = reinterpret_cast<uintptr_t>(parent) | (parent_color_ & 1);
+    }
+    void set_color(Color color) noexcept {
+      parent_color_ = (parent_color_ & ~uintptr_t(1)) | uintptr_t(color);
+    }
+
+    uintptr_t parent_color_;
+    NodeBase *left_, *right_;
+  };
+  // PrefixLess trees cache a prefix of every key in its node
+  static constexpr size_t prefix_bytes_ = prefix_bytes<Compare>::value;
+  class Node : public NodeBase, KeyPrefix<prefix_bytes_> {
     friend RBTree;
 
   public:
-    Node(Node *parent, Node *left, Node *right, Color color,
-         const key_type &key, const value_type &value)
-        : parent_(parent), left_(left), right_(right), color_(color), key_(key),
-          value_(value) {}
-    void swap(Node *other) noexcept {
-      if (parent_) {
-        if (parent_->left_ == this) {
-          parent_->left_ = other;
-        } else {
-          parent_->right_ = other;
-        }
-      }
-      if (other->parent_) {
-        if (other->parent_->left_ == other) {
-          other->parent_->left_ = this;
-        } else {
-          other->parent_->right_ = this;
-        }
-      }
-      std::swap(color_, other->color_);
-      std::swap(left_, other->left_);
-      std::swap(right_, other->right_);
-      std::swap(parent_, other->parent_);
-      if (left_)
-        left_->parent_ = this;
-      if (right_)
-        right_->parent_ = this;
-      if (other->left_)
-        other->left_->parent_ = other;
-      if (other->right_)
-        other->right_->parent_ = other;
+    // the value is built in place by the tree through its allocator
+    const key_type &key() const noexcept { return KeyOfValue()(value()); }
+    value_type &value() noexcept {
+      return *static_cast<value_type *>(static_cast<void *>(value_));
+    }
+    const value_type &value() const noexcept {
+      return *static_cast<const value_type *>(
+          static_cast<const void *>(value_));
     }
-
-  public:
-    Node *parent_, *left_, *right_;
-    Color color_;
 
   private:
-    key_type key_;
-    value_type value_;
+    alignas(value_type) unsigned char value_[sizeof(value_type)];
   };
   class iterator {
     friend RBTree;
 
   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = RBTree::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type *;
+    using reference = value_type &;
+
     iterator() : node_(nullptr) {}
-    explicit iterator(Node *node) : node_(node) {}
-    reference operator*() const noexcept { return node_->value_; }
+    explicit iterator(NodeBase *node) : node_(node) {}
+    reference operator*() const noexcept {
+      return static_cast<Node *>(node_)->value();
+    }
     iterator &operator++() noexcept {
       node_ = next_node(node_);
       return *this;
@@ -92,15 +227,23 @@ public:
     }
 
   private:
-    Node *node_;
+    NodeBase *node_;
   };
   class const_iterator {
     friend RBTree;
 
   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = RBTree::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
     const_iterator() : node_(nullptr) {}
-    explicit const_iterator(Node *node) : node_(node) {}
-    const_reference operator*() const noexcept { return node_->value_; }
+    explicit const_iterator(NodeBase *node) : node_(node) {}
+    const_reference operator*() const noexcept {
+      return static_cast<Node *>(node_)->value();
+    }
     const_iterator &operator++() noexcept {
       node_ = next_node(node_);
       return *this;
@@ -124,458 +267,1777 @@ public:
     }
 
     bool operator!=(const const_iterator &other) const noexcept {
-      return iterator(min(head_));
+      return node_ != other.node_;
+    }
+
+  private:
+    NodeBase *node_;
+  };
+
+  // Nodes cut loose from a tree by detach(). reclaim() frees them in
+  // bounded steps; whatever is left goes when the object is destroyed.
+  // Freeing on another thread requires an allocator that tolerates it.
+  class Detached {
+    friend RBTree;
+
+  public:
+    Detached(Detached &&other) noexcept
+        : root_(other.root_), node_count_(other.node_count_),
+          pool_(std::move(other.pool_)) {
+      other.root_ = nullptr;
+      other.node_count_ = 0;
+    }
+    Detached &operator=(Detached &&) = delete;
+    ~Detached() {
+      size_type steps = std::numeric_limits<size_type>::max();
+      free_nodes(pool_, root_, steps);
+    }
+    // visits at most steps nodes; true while some remain
+    bool reclaim(size_type steps) noexcept {
+      node_count_ -= free_nodes(pool_, root_, steps);
+      if (root_)
+        return true;
+      pool_.release();
+      return false;
     }
+    size_type size() const noexcept { return node_count_; }
 
   private:
+    explicit Detached(const Allocator &alloc)
+        : root_(nullptr), node_count_(0), pool_(alloc) {}
+    NodeBase *root_;
+    size_type node_count_;
+    NodePool<Node, Allocator> pool_;
+  };
+
+  // Owns an element taken out of a tree by extract(). insert() hands it to
+  // a tree with an equal allocator without copying or allocating. The node
+  // stays in the slab it came from, which the handle keeps alive; a handle
+  // dropped with its element returns the slot to that slab's store, where
+  // the tree it came from picks it up again.
+  class NodeHandle {
+    friend RBTree;
+
+  public:
+    using key_type = RBTree::key_type;
+    using value_type = RBTree::value_type;
+    using allocator_type = Allocator;
+
+    NodeHandle() noexcept : node_(nullptr) {}
+    NodeHandle(NodeHandle &&other) noexcept
+        : node_(other.node_), slabs_(std::move(other.slabs_)),
+          alloc_(std::move(other.alloc_)) {
+      other.node_ = nullptr;
+      other.alloc_.reset();
+    }
+    NodeHandle &operator=(NodeHandle &&other) noexcept {
+      if (this != &other) {
+        reset();
+        std::swap(node_, other.node_);
+        slabs_.swap(other.slabs_);
+        alloc_.swap(other.alloc_);
+      }
+      return *this;
+    }
+    ~NodeHandle() { reset(); }
+
+    bool empty() const noexcept { return node_ == nullptr; }
+    explicit operator bool() const noexcept { return node_ != nullptr; }
+    allocator_type get_allocator() const { return *alloc_; }
+    value_type &value() const noexcept { return node_->value(); }
+    // the key may be changed before the node is inserted again
+    key_type &key() const noexcept {
+      return const_cast<key_type &>(KeyOfValue()(node_->value()));
+    }
+    decltype(auto) mapped() const noexcept { return (node_->value().second); }
+
+  private:
+    NodeHandle(Node *node, std::shared_ptr<void> slabs, const Allocator &alloc)
+        : node_(node), slabs_(std::move(slabs)), alloc_(alloc) {}
+    Node *release() noexcept {
+      Node *x = node_;
+      node_ = nullptr;
+      slabs_.reset();
+      alloc_.reset();
+      return x;
+    }
+    void reset() noexcept {
+      if (node_) {
+        Allocator alloc(*alloc_);
+        alloc_traits::destroy(alloc, std::addressof(node_->value()));
+        NodePool<Node, Allocator>::return_slot(slabs_, node_);
+      }
+      release();
+    }
+
     Node *node_;
+    std::shared_ptr<void> slabs_;
+    std::optional<Allocator> alloc_;
   };
 
   // constructors and assertion operators
-  RBTree() : root_(nullptr), node_count_(0) {
-    head_ =
-        new Node(nullptr, nullptr, nullptr, BLACK, key_type(), value_type());
+  RBTree() : RBTree(Compare(), Allocator()) {}
+  explicit RBTree(const Allocator &alloc) : RBTree(Compare(), alloc) {}
+  explicit RBTree(const Compare &comp, const Allocator &alloc = Allocator())
+      : head_{uintptr_t(BLACK), nullptr, nullptr}, root_(nullptr),
+        node_count_(0), comp_(comp), pool_(alloc), churn_(0),
+        compact_after_(0), compact_order_(CompactOrder::IN_ORDER),
+        at_edge_(false) {}
+  RBTree(const RBTree &other)
+      : RBTree(other.comp_, alloc_traits::select_on_container_copy_construction(
+                                other.get_allocator())) {
+    set_auto_compact(other.compact_after_, other.compact_order_);
+    copy_from(other);
   }
-  RBTree(const RBTree &other) noexcept : root_(nullptr), node_count_(0) {
-    head_ =
-        new Node(nullptr, nullptr, nullptr, BLACK, key_type(), value_type());
-    for (auto i = other.begin(); i != other.end(); ++i) {
-      fix(insert_non_uniq(i.node_.key_, i.node_.value_));
-    }
+  RBTree(const RBTree &other, const Allocator &alloc)
+      : RBTree(other.comp_, alloc) {
+    set_auto_compact(other.compact_after_, other.compact_order_);
+    copy_from(other);
   }
-  RBTree(RBTree &&other) noexcept : root_(nullptr), node_count_(0) {
-    head_ =
-        new Node(nullptr, nullptr, nullptr, BLACK, key_type(), value_type());
-    std::swap(head_, other.head_);
-    std::swap(root_, other.root_);
-    std::swap(node_count_, other.node_count_);
-    root_->parent_ = head_;
+  RBTree(RBTree &&other) noexcept
+      : head_{uintptr_t(BLACK), nullptr, nullptr}, root_(nullptr),
+        node_count_(0), comp_(other.comp_), pool_(std::move(other.pool_)),
+        churn_(0), compact_after_(other.compact_after_),
+        compact_order_(other.compact_order_), at_edge_(false) {
+    swap_links(other);
   }
-  RBTree &operator=(const RBTree &other) noexcept {
-    for (auto i = other.begin(); i != other.end(); ++i) {
-      fix(insert_non_uniq(i.node_.key_, i.node_.value_));
+  RBTree(RBTree &&other, const Allocator &alloc) : RBTree(other.comp_, alloc) {
+    set_auto_compact(other.compact_after_, other.compact_order_);
+    if (alloc == other.get_allocator()) {
+      pool_.swap(other.pool_, std::false_type());
+      swap_links(other);
+    } else {
+      move_from(other);
     }
+  }
+  // the copy is built aside and swapped in, so a throwing element copy
+  // leaves this tree as it was
+  RBTree &operator=(const RBTree &other) {
+    if (this == &other)
+      return *this;
+    using propagate =
+        typename alloc_traits::propagate_on_container_copy_assignment;
+    RBTree tmp(other.comp_,
+               propagate::value ? other.get_allocator() : get_allocator());
+    tmp.pool_.set_budget(pool_.budget());
+    tmp.copy_from(other);
+    comp_ = other.comp_;
+    set_auto_compact(other.compact_after_, other.compact_order_);
+    swap_links(tmp);
+    pool_.swap(tmp.pool_, propagate());
     return *this;
   }
-  RBTree &operator=(RBTree &&other) noexcept {
+  RBTree &operator=(RBTree &&other) noexcept(
+      alloc_traits::propagate_on_container_move_assignment::value ||
+      alloc_traits::is_always_equal::value) {
+    if (this == &other)
+      return *this;
     delete_tree();
-    std::swap(head_, other.head_);
-    std::swap(root_, other.root_);
-    std::swap(node_count_, other.node_count_);
-    root_->parent_ = head_;
+    comp_ = other.comp_;
+    set_auto_compact(other.compact_after_, other.compact_order_);
+    if (alloc_traits::propagate_on_container_move_assignment::value ||
+        get_allocator() == other.get_allocator()) {
+      pool_.release();
+      pool_.swap(
+          other.pool_,
+          typename alloc_traits::propagate_on_container_move_assignment());
+      swap_links(other);
+    } else {
+      move_from(other);
+    }
     return *this;
   }
 
   // destructors
-  ~RBTree() {
-    delete_tree();
-    delete head_;
-  }
+  ~RBTree() { delete_tree(); }
 
   // functions
-  void free_tree_memory(Node *n) noexcept {
-    if (!n)
-      return;
-    free_tree_memory(n->left_);
-    free_tree_memory(n->right_);
-    --node_count_;
-    delete n;
+  allocator_type get_allocator() const { return pool_.get_allocator(); }
+  void free_tree_memory(NodeBase *n) noexcept {
+    size_type steps = std::numeric_limits<size_type>::max();
+    node_count_ -= free_nodes(pool_, n, steps);
   }
   void delete_tree() noexcept {
     free_tree_memory(root_);
     root_ = nullptr;
     update_head();
   }
-  Node *grandparent(Node *x) const noexcept {
-    return x->parent_ ? x->parent_->parent_ : nullptr;
+  // empties the tree in O(1); the old nodes and their slabs go to the
+  // returned object, which may free them later, piecewise or on another
+  // thread. The new pool keeps the budget, the detached slabs stop
+  // counting against it.
+  Detached detach() noexcept {
+    Detached garbage(pool_.get_allocator());
+    auto budget = pool_.budget();
+    garbage.pool_.swap(pool_, std::false_type());
+    garbage.pool_.set_budget(nullptr);
+    pool_.set_budget(std::move(budget));
+    garbage.root_ = root_;
+    garbage.node_count_ = node_count_;
+    root_ = nullptr;
+    node_count_ = 0;
+    update_head();
+    return garbage;
   }
-  Node *uncle(Node *x) const noexcept {
-    Node *g = grandparent(x);
-    if (!g)
+  // links value unless its key is present, then returns nullptr; the
+  // caller runs fix() on the new node
+  Node *insert(value_type value) {
+    Position pos = locate(KeyOfValue()(value));
+    if (pos.found)
       return nullptr;
-    return g->left_ == x->parent_ ? g->right_ : g->left_;
+    return link_node(create_node(std::move(value)), pos.node, pos.to_left);
   }
-  Node *insert(key_type key, value_type value) noexcept {
-    Node new_node(nullptr, nullptr, nullptr, RED, key, value);
-    if (!root_) {
-      new_node.color_ = BLACK;
-      root_ = new Node(new_node);
-      node_count_ = 1;
-      return root_;
-    }
-    Node *prev = root_;
-    for (Node *i = root_; i;
-         prev = i, i = (comp_(key, i->key_) ? i->left_ : i->right_)) {
-    }
-    new_node.parent_ = prev;
-    if (comp_(key, prev->key_)) {
-      prev->left_ = new Node(new_node);
-      ++node_count_;
-      return prev->left_;
-    } else if (comp_(prev->key_, key)) {
-      prev->right_ = new Node(new_node);
-      ++node_count_;
-      return prev->right_;
-    }
-    return nullptr;
-  }
-
-  Node *insert_non_uniq(key_type key, value_type value) noexcept {
-    Node new_node(nullptr, nullptr, nullptr, RED, key, value);
-    if (!root_) {
-      new_node.color_ = BLACK;
-      root_ = new Node(new_node);
-      node_count_ = 1;
-      return root_;
+  Node *insert_non_uniq(value_type value) {
+    const key_type &key = KeyOfValue()(value);
+    NodeBase *parent = &head_;
+    bool to_left = true;
+    for (NodeBase *i = root_; i; i = to_left ? i->left_ : i->right_) {
+      parent = i;
+      to_left = comp_(key, key_of(i));
     }
-    Node *prev = root_;
-    for (Node *i = root_; i;
-         prev = i, i = (comp_(key, i->key_) ? i->left_ : i->right_)) {
+    return link_node(create_node(std::move(value)), parent, to_left);
+  }
+  // Where key is, or where it would be linked: node is the match when
+  // found, otherwise the parent to hang a new node under on side to_left.
+  // One comparison per level; the last node not greater than key is
+  // checked for equality at the bottom.
+  struct Position {
+    NodeBase *node;
+    bool found;
+    bool to_left;
+  };
+  // While insertions keep landing past either end, the ends are tried
+  // before descending, so sorted ingest costs one or two comparisons.
+  template <typename K> Position locate(const K &key) const {
+    if (at_edge_ && root_) {
+      if (comp_(key_of(head_.right_), key))
+        return {head_.right_, false, false};
+      if (comp_(key, key_of(head_.left_)))
+        return {head_.left_, false, true};
     }
-
-    new_node.parent_ = prev;
-    if (comp_(key, prev->key_)) {
-      prev->left_ = new Node(new_node);
-      ++node_count_;
-      return prev->left_;
+    if (!root_)
+      return {header(), false, true};
+    return descend(root_, key);
+  }
+  // locate() for a key not less than the one at finger. Keys at or right
+  // after the finger cost two comparisons; past its successor the search
+  // climbs only until the key is within reach, so locating m ascending
+  // keys one after another costs O(m log(n/m + 1)) comparisons in all.
+  template <typename K>
+  Position locate_from(NodeBase *finger, const K &key) const {
+    if (finger == header() || !root_)
+      return locate(key);
+    NodeBase *succ = next_node(finger);
+    if (succ == header() || comp_(key, key_of(succ))) {
+      if (!comp_(key_of(finger), key))
+        return {finger, true, false};
+      // succ, if any, is the leftmost node under the finger's right link
+      return finger->right_ ? Position{succ, false, true}
+                            : Position{finger, false, false};
+    }
+    if (!comp_(key_of(succ), key))
+      return {succ, true, false};
+    NodeBase *n = succ;
+    for (; n != root_; n = n->parent()) {
+      NodeBase *p = n->parent();
+      if (p->left_ == n && !comp_(key_of(p), key)) {
+        if (!comp_(key, key_of(p)))
+          return {p, true, false};
+        break;
+      }
+    }
+    // every node climbed through is less than key, n included
+    return n->right_ ? descend(n->right_, key) : Position{n, false, false};
+  }
+  // Visits the entries of a batch in ascending key order, equal keys in
+  // batch order: visit(i, pos) gets entry i and the Position of key_at(i),
+  // and returns where the key now is, or end() if it is gone. Each search
+  // starts from the last key still in the tree.
+  template <typename KeyAt, typename Visit>
+  void sweep(size_type n, KeyAt key_at, Visit visit) const {
+    std::vector<size_type> order(n);
+    for (size_type i = 0; i < n; ++i)
+      order[i] = i;
+    auto less = [&](size_type a, size_type b) {
+      return comp_(key_at(a), key_at(b));
+    };
+    if (!std::is_sorted(order.begin(), order.end(), less))
+      std::stable_sort(order.begin(), order.end(), less);
+    NodeBase *finger = header();
+    for (size_type i : order) {
+      Position pos = locate_from(finger, key_at(i));
+      // should visit erase the finger, the search falls back to the node
+      // before it
+      NodeBase *before = finger;
+      if (pos.found && pos.node == finger)
+        before = finger == head_.left_ ? header() : prev_node(finger);
+      NodeBase *x = visit(i, pos).node_;
+      finger = x != header() ? x : before;
+    }
+  }
+  // find() for n keys in one sweep: each search climbs from the last key
+  // found, or from the last one below a missing key, so sorted or dense
+  // probes cost about as much as a merge join. res[i] is where key_at(i)
+  // is, or end().
+  template <typename KeyAt>
+  std::vector<iterator> find_many(size_type n, KeyAt key_at) const {
+    std::vector<iterator> res(n, end());
+    sweep(n, key_at, [&](size_type i, const Position &pos) {
+      if (pos.found)
+        return res[i] = iterator(pos.node);
+      if (pos.node == header() || (pos.to_left && pos.node == head_.left_))
+        return end();
+      return iterator(pos.to_left ? prev_node(pos.node) : pos.node);
+    });
+    return res;
+  }
+  // locate() for a key expected right before hint; a correct hint costs
+  // two comparisons, any other falls back to a full descent
+  Position locate(iterator hint, const key_type &key) const {
+    NodeBase *h = hint.node_;
+    if (!root_)
+      return {header(), false, true};
+    if (h == header()) {
+      if (comp_(key_of(head_.right_), key))
+        return {head_.right_, false, false};
+      return locate(key);
+    }
+    if (comp_(key, key_of(h))) {
+      if (h == head_.left_)
+        return {h, false, true};
+      NodeBase *before = prev_node(h);
+      if (!comp_(key_of(before), key))
+        return locate(key);
+      if (!before->right_)
+        return {before, false, false};
+      return {h, false, true};
+    }
+    if (!comp_(key_of(h), key))
+      return {h, true, false};
+    NodeBase *after = next_node(h);
+    if (after != header() && !comp_(key, key_of(after)))
+      return locate(key);
+    if (!h->right_)
+      return {h, false, false};
+    return {after, false, true};
+  }
+  template <typename... Args>
+  std::pair<Node *, bool> emplace_hint(iterator hint, Args &&...args) {
+    Node *x = create_node(std::forward<Args>(args)...);
+    Position pos = locate(hint, x->key());
+    if (pos.found) {
+      destroy_node(x);
+      return {static_cast<Node *>(pos.node), false};
+    }
+    fix(link_node(x, pos.node, pos.to_left));
+    return {x, true};
+  }
+  // Constructs the value in its final node from args, then links it unless
+  // its key is taken, in which case the node is dropped again. Returns the
+  // node holding the key and whether it was inserted.
+  template <typename... Args>
+  std::pair<Node *, bool> emplace(Args &&...args) {
+    Node *x = create_node(std::forward<Args>(args)...);
+    Position pos = locate(x->key());
+    if (pos.found) {
+      destroy_node(x);
+      return {static_cast<Node *>(pos.node), false};
+    }
+    fix(link_node(x, pos.node, pos.to_left));
+    return {x, true};
+  }
+  // like emplace, but nothing is constructed when key is already present
+  template <typename K, typename... Args>
+  std::pair<Node *, bool> try_emplace(const K &key, Args &&...args) {
+    Position pos = locate(key);
+    if (pos.found)
+      return {static_cast<Node *>(pos.node), false};
+    return {emplace_at(pos, std::forward<Args>(args)...), true};
+  }
+  // links a value built from args at a free position found by locate();
+  // nothing may be inserted or erased in between
+  template <typename... Args>
+  Node *emplace_at(const Position &pos, Args &&...args) {
+    Node *x = create_node(std::forward<Args>(args)...);
+    fix(link_node(x, pos.node, pos.to_left));
+    return x;
+  }
+  // hangs a fresh red node under parent; the caller runs fix() afterwards
+  Node *link_node(Node *x, NodeBase *parent, bool to_left) noexcept {
+    at_edge_ = parent != &head_ && (to_left ? parent == head_.left_
+                                             : parent == head_.right_);
+    x->set_parent(parent);
+    if (parent == &head_)
+      root_ = x;
+    else if (to_left)
+      parent->left_ = x;
+    else
+      parent->right_ = x;
+    ++node_count_;
+    ++churn_;
+    return x;
+  }
+  void rotate_left(NodeBase *x) noexcept {
+    NodeBase *y = x->right_;
+    x->right_ = y->left_;
+    if (y->left_)
+      y->left_->set_parent(x);
+    replace_child(x, y);
+    y->left_ = x;
+    x->set_parent(y);
+  }
+  void rotate_right(NodeBase *x) noexcept {
+    NodeBase *y = x->left_;
+    x->left_ = y->right_;
+    if (y->right_)
+      y->right_->set_parent(x);
+    replace_child(x, y);
+    y->right_ = x;
+    x->set_parent(y);
+  }
+  // puts v where u hangs in the tree; u keeps its own links
+  void replace_child(NodeBase *u, NodeBase *v) noexcept {
+    if (u == root_)
+      root_ = v;
+    else if (u->parent()->left_ == u)
+      u->parent()->left_ = v;
+    else
+      u->parent()->right_ = v;
+    if (v)
+      v->set_parent(u->parent());
+  }
+  static bool is_red(const NodeBase *x) noexcept {
+    return x && x->color() == RED;
+  }
+  static const key_type &key_of(const NodeBase *x) noexcept {
+    return static_cast<const Node *>(x)->key();
+  }
+  template <typename K>
+  static constexpr bool three_way_v =
+      prefix_bytes_ > 0 || uses_three_way<Compare, Key, K>::value;
+  // What a three-way descent holds against each node: the key itself, or
+  // under PrefixLess the key with its prefix worked out once.
+  struct PrefixProbe {
+    KeyPrefix<prefix_bytes_> prefix;
+    std::string_view key;
+  };
+  template <typename K>
+  static decltype(auto) probe_of(const K &key) noexcept {
+    if constexpr (prefix_bytes_ > 0) {
+      PrefixProbe probe{{}, std::string_view(key)};
+      probe.prefix.cache_prefix(probe.key);
+      return probe;
     } else {
-      prev->right_ = new Node(new_node);
-      ++node_count_;
-      return prev->right_;
-    }
-  }
-  void small_left_turn(Node *x) noexcept {
-    Node *g = grandparent(x);
-    Node *p = x->parent_;
-    if (g) {
-      g->left_ = x;
-      x->parent_ = g;
-      p->right_ = x->left_;
-      x->left_ = p;
-      p->parent_ = x;
-    }
-  }
-
-  void small_right_turn(Node *x) noexcept {
-    Node *g = grandparent(x);
-    Node *p = x->parent_;
-    if (g) {
-      g->right_ = x;
-      x->parent_ = g;
-      p->left_ = x->right_;
-      x->right_ = p;
-      p->parent_ = x;
-    }
-  }
-  void large_left_turn(Node *x) noexcept {
-    Node *g = grandparent(x);
-    Node *p = x->parent_;
-    if (!g)
-      return;
-    if (g->parent_) {
-      if (g->parent_->left_ == g)
-        g->parent_->left_ = p;
-      else
-        g->parent_->right_ = p;
-    }
-    p->parent_ = g->parent_;
-    g->parent_ = p;
-    g->right_ = p->left_;
-    if (g->right_)
-      g->right_->parent_ = g;
-    p->left_ = g;
-    if (root_ == g)
-      root_ = p;
-  }
-  void large_right_turn(Node *x) noexcept {
-    Node *g = grandparent(x);
-    Node *p = x->parent_;
-    if (!g)
-      return;
-    if (g->parent_) {
-      if (g->parent_->left_ == g)
-        g->parent_->left_ = p;
-      else
-        g->parent_->right_ = p;
-    }
-    p->parent_ = g->parent_;
-    g->parent_ = p;
-    g->left_ = p->right_;
-    if (g->left_)
-      g->left_->parent_ = g;
-    p->right_ = g;
-    if (root_ == g)
-      root_ = p;
-  }
-  Node *find(key_type key) const noexcept {
-    for (Node *i = root_; i; i = (comp_(key, i->key_) ? i->left_ : i->right_))
-      if (!comp_(key, i->key_) && !comp_(i->key_, key))
-        return i;
-    return head_;
-  }
-  void fix(Node *x) noexcept {
-    root_->parent_ = nullptr;
-    Node *g = grandparent(x);
-    if (uncle(x) && uncle(x)->color_ == RED) {
-      // red uncle case
-      x->parent_->color_ = BLACK;
-      uncle(x)->color_ = BLACK;
-      g->color_ = RED;
-      fix(g);
-    } else if (g && (uncle(x) == nullptr || uncle(x)->color_ == BLACK) &&
-               x->parent_ && x->parent_->color_ == RED) {
-      // black uncle case
-      if (g->left_ == x->parent_ && x->parent_->right_ == x) {
-        // LR case
-        small_left_turn(x);
-        x->parent_->color_ = RED;
-        x->color_ = BLACK;
-        large_right_turn(x->left_);
-      } else if (g->right_ == x->parent_ && x->parent_->left_ == x) {
-        // RL case
-        small_right_turn(x);
-        x->parent_->color_ = RED;
-        x->color_ = BLACK;
-        large_left_turn(x->right_);
-      } else if (g->left_ == x->parent_ && x->parent_->left_ == x) {
+      return (key);
+    }
+  }
+  // the sign of a probe against the key at x, for three_way_v keys only;
+  // a PrefixLess node's key is read only past a tied prefix
+  template <typename P>
+  static int order(const P &probe, const NodeBase *x) noexcept {
+    if constexpr (prefix_bytes_ > 0) {
+      const Node *n = static_cast<const Node *>(x);
+      int c = probe.prefix.order(*n);
+      if (c != 0 || !probe.prefix.truncated())
+        return c;
+      c = std::string_view(n->key())
+              .substr(prefix_bytes_)
+              .compare(probe.key.substr(prefix_bytes_));
+      return (c < 0) - (c > 0);
+    } else if constexpr (has_compare<Key, P>::value) {
+      int c = key_of(x).compare(probe);
+      return (c < 0) - (c > 0);
+    }
+#ifdef __cpp_lib_three_way_comparison
+    else {
+      auto c = probe <=> key_of(x);
+      return (c > 0) - (c < 0);
+    }
+#endif
+  }
+  // Ordered lookups descend with one comparison per level; find() checks
+  // the lower bound for equality once at the bottom, while a three-way
+  // descent stops at the match instead. Any K the comparator orders
+  // against key_type will do; the containers only pass one when Compare is
+  // transparent.
+  template <typename K> iterator find(const K &key) const noexcept {
+    if constexpr (three_way_v<K>) {
+      const auto &probe = probe_of(key);
+      for (NodeBase *i = root_; i;) {
+        int c = order(probe, i);
+        if (c == 0)
+          return iterator(i);
+        i = c < 0 ? i->left_ : i->right_;
+      }
+      return end();
+    } else {
+      NodeBase *x = lower_bound_node(key);
+      return x != header() && !comp_(key, key_of(x)) ? iterator(x) : end();
+    }
+  }
+  template <typename K> iterator lower_bound(const K &key) const noexcept {
+    return iterator(lower_bound_node(key));
+  }
+  template <typename K> iterator upper_bound(const K &key) const noexcept {
+    NodeBase *bound = header();
+    if constexpr (three_way_v<K>) {
+      const auto &probe = probe_of(key);
+      for (NodeBase *i = root_; i;) {
+        int c = order(probe, i);
+        // past a match, the bound is the next node
+        if (c == 0)
+          return iterator(i->right_ ? min(i->right_) : bound);
+        if (c < 0) {
+          bound = i;
+          i = i->left_;
+        } else {
+          i = i->right_;
+        }
+      }
+    } else {
+      for (NodeBase *i = root_; i;) {
+        if (comp_(key, key_of(i))) {
+          bound = i;
+          i = i->left_;
+        } else {
+          i = i->right_;
+        }
+      }
+    }
+    return iterator(bound);
+  }
+  // keys are unique, so the range past the lower bound is one element at
+  // most and one more comparison settles it
+  template <typename K>
+  std::pair<iterator, iterator> equal_range(const K &key) const noexcept {
+    if constexpr (three_way_v<K>) {
+      NodeBase *bound = header();
+      const auto &probe = probe_of(key);
+      for (NodeBase *i = root_; i;) {
+        int c = order(probe, i);
+        if (c == 0)
+          return {iterator(i), iterator(next_node(i))};
+        if (c < 0) {
+          bound = i;
+          i = i->left_;
+        } else {
+          i = i->right_;
+        }
+      }
+      return {iterator(bound), iterator(bound)};
+    } else {
+      NodeBase *x = lower_bound_node(key);
+      if (x == header() || comp_(key, key_of(x)))
+        return {iterator(x), iterator(x)};
+      return {iterator(x), iterator(next_node(x))};
+    }
+  }
+  template <typename K> size_type count(const K &key) const noexcept {
+    return find(key) != end();
+  }
+  template <typename K>
+  NodeBase *lower_bound_node(const K &key) const noexcept {
+    NodeBase *bound = header();
+    if constexpr (three_way_v<K>) {
+      const auto &probe = probe_of(key);
+      for (NodeBase *i = root_; i;) {
+        int c = order(probe, i);
+        if (c == 0)
+          return i;
+        if (c < 0) {
+          bound = i;
+          i = i->left_;
+        } else {
+          i = i->right_;
+        }
+      }
+    } else {
+      for (NodeBase *i = root_; i;) {
+        if (!comp_(key_of(i), key)) {
+          bound = i;
+          i = i->left_;
+        } else {
+          i = i->right_;
+        }
+      }
+    }
+    return bound;
+  }
+  void fix(NodeBase *x) noexcept {
+    fix_up(x);
+    root_->set_color(BLACK);
+    update_head();
+  }
+  // resolves a red x under a red parent up to root_, which may end up red
+  void fix_up(NodeBase *x) noexcept {
+    while (x != root_ && is_red(x->parent())) {
+      NodeBase *p = x->parent();
+      NodeBase *g = p->parent();
+      if (g->left_ == p) {
+        NodeBase *u = g->right_;
+        if (is_red(u)) {
+          // red uncle case
+          p->set_color(BLACK);
+          u->set_color(BLACK);
+          g->set_color(RED);
+          x = g;
+          continue;
+        }
+        if (p->right_ == x) {
+          // LR case
+          rotate_left(p);
+          x = p;
+          p = x->parent();
+        }
         // LL case
-        x->parent_->parent_->color_ = RED;
-        x->parent_->color_ = BLACK;
-        large_right_turn(x);
-      } else if (g->right_ == x->parent_ && x->parent_->right_ == x) {
+        p->set_color(BLACK);
+        g->set_color(RED);
+        rotate_right(g);
+      } else {
+        NodeBase *u = g->left_;
+        if (is_red(u)) {
+          // red uncle case
+          p->set_color(BLACK);
+          u->set_color(BLACK);
+          g->set_color(RED);
+          x = g;
+          continue;
+        }
+        if (p->left_ == x) {
+          // RL case
+          rotate_right(p);
+          x = p;
+          p = x->parent();
+        }
         // RR case
-        x->parent_->parent_->color_ = RED;
-        x->parent_->color_ = BLACK;
-        large_left_turn(x);
+        p->set_color(BLACK);
+        g->set_color(RED);
+        rotate_left(g);
       }
     }
-    root_->color_ = BLACK;
-    update_head();
   }
-  static Node *min(Node *subtree) {
+  static NodeBase *min(NodeBase *subtree) {
     for (; subtree->left_; subtree = subtree->left_) {
     }
     return subtree;
   }
-  static Node *max(Node *subtree) {
+  static NodeBase *max(NodeBase *subtree) {
     for (; subtree->right_; subtree = subtree->right_) {
     }
     return subtree;
   }
   void delete_node(iterator i) noexcept { delete_node(i.node_); }
-  void delete_node(Node *x) noexcept {
-    root_->parent_ = nullptr;
-    // red node with 0 children
-    if (x->color_ == RED && !x->left_ && !x->right_) {
-      if (x->parent_->left_ == x) {
-        x->parent_->left_ = nullptr;
+  void delete_node(NodeBase *z) noexcept {
+    unlink_node(z);
+    destroy_node(static_cast<Node *>(z));
+  }
+  // takes z out of the tree and rebalances; z itself is left alone
+  void unlink_node(NodeBase *z) noexcept {
+    NodeBase *y = z;
+    NodeBase *x = nullptr;
+    NodeBase *x_parent = nullptr;
+    Color removed_color = z->color();
+    if (!z->left_ || !z->right_) {
+      // node with at most 1 child
+      x = z->left_ ? z->left_ : z->right_;
+      x_parent = z->parent();
+      replace_child(z, x);
+    } else {
+      // node with 2 children is replaced by its successor
+      y = min(z->right_);
+      removed_color = y->color();
+      x = y->right_;
+      if (y->parent() == z) {
+        x_parent = y;
       } else {
-        x->parent_->right_ = nullptr;
+        x_parent = y->parent();
+        replace_child(y, x);
+        y->right_ = z->right_;
+        y->right_->set_parent(y);
       }
-      delete x;
-      --node_count_;
-      update_head();
-      return;
+      replace_child(z, y);
+      y->left_ = z->left_;
+      y->left_->set_parent(y);
+      y->set_color(z->color());
     }
-    // any color node with 2 children
-    if (x->left_ && x->right_) {
-      Node *replace_node = max(x->left_);
-      x->swap(replace_node);
-      delete_node(x);
-      update_head();
+    if (removed_color == BLACK)
+      rebalance(x, x_parent);
+    --node_count_;
+    ++churn_;
+    update_head();
+  }
+
+  void update_head() noexcept {
+    if (!root_) {
+      head_.left_ = nullptr;
+      head_.right_ = nullptr;
       return;
     }
-    // black node with 1 child
-    if (x->color_ == BLACK &&
-        ((x->left_ && !x->right_) || (!x->left_ && x->right_))) {
-      Node *child = x->left_ ? x->left_ : x->right_;
-      x->swap(child);
-      delete_node(x);
-      update_head();
-      return;
+    head_.left_ = min(root_);
+    head_.right_ = max(root_);
+    root_->set_parent(&head_);
+  }
+  // restores the black height after a black node left the x_parent subtree
+  void rebalance(NodeBase *x, NodeBase *x_parent) noexcept {
+    while (x != root_ && !is_red(x)) {
+      if (x_parent->left_ == x) {
+        NodeBase *sibling = x_parent->right_;
+        if (is_red(sibling)) {
+          // case sibling is red
+          sibling->set_color(BLACK);
+          x_parent->set_color(RED);
+          rotate_left(x_parent);
+          sibling = x_parent->right_;
+        }
+        if (!is_red(sibling->left_) && !is_red(sibling->right_)) {
+          // case both children are black
+          sibling->set_color(RED);
+          x = x_parent;
+          x_parent = x->parent();
+          continue;
+        }
+        if (!is_red(sibling->right_)) {
+          // case left_ child is red, right_ is black
+          sibling->left_->set_color(BLACK);
+          sibling->set_color(RED);
+          rotate_right(sibling);
+          sibling = x_parent->right_;
+        }
+        // case right_ child is red, left_ is any
+        sibling->set_color(x_parent->color());
+        x_parent->set_color(BLACK);
+        sibling->right_->set_color(BLACK);
+        rotate_left(x_parent);
+      } else {
+        NodeBase *sibling = x_parent->left_;
+        if (is_red(sibling)) {
+          // case sibling is red
+          sibling->set_color(BLACK);
+          x_parent->set_color(RED);
+          rotate_right(x_parent);
+          sibling = x_parent->left_;
+        }
+        if (!is_red(sibling->left_) && !is_red(sibling->right_)) {
+          // case both children are black
+          sibling->set_color(RED);
+          x = x_parent;
+          x_parent = x->parent();
+          continue;
+        }
+        if (!is_red(sibling->left_)) {
+          // case right_ child is red, left_ is black
+          sibling->right_->set_color(BLACK);
+          sibling->set_color(RED);
+          rotate_left(sibling);
+          sibling = x_parent->left_;
+        }
+        // case left_ child is red, right_ is any
+        sibling->set_color(x_parent->color());
+        x_parent->set_color(BLACK);
+        sibling->left_->set_color(BLACK);
+        rotate_right(x_parent);
+      }
+      x = root_;
     }
-    // black node with 0 children
-    if (x->color_ == BLACK && !x->left_ && !x->right_) {
-      if (x->parent_) {
-        if (x->parent_->left_ == x) {
-          x->parent_->left_ = nullptr;
-          rebalance_right_subtree(x);
+    if (x)
+      x->set_color(BLACK);
+  }
+  // the sentinel is the only node without a parent
+  static NodeBase *next_node(NodeBase *x) {
+    if (x->right_)
+      return min(x->right_);
+    NodeBase *p = x->parent();
+    for (; p->parent() && p->right_ == x; x = p, p = p->parent()) {
+    }
+    return p;
+  }
+  static NodeBase *prev_node(NodeBase *x) {
+    if (!x->parent())
+      return x->right_;
+    if (x->left_)
+      return max(x->left_);
+    NodeBase *p = x->parent();
+    for (; p->parent() && p->left_ == x; x = p, p = p->parent()) {
+    }
+    return p;
+  }
+  // Replaces the contents with [first, last), which must be sorted by key,
+  // in O(n): the nodes are built into one slab and hung as a perfectly
+  // balanced tree. With checked, repeated keys keep their first element
+  // and a range out of order throws std::invalid_argument; on any error
+  // the tree keeps its old contents.
+  template <typename InputIt>
+  void assign_sorted(InputIt first, InputIt last, bool checked = true) {
+    RBTree tmp(comp_, get_allocator());
+    tmp.pool_.set_budget(pool_.budget());
+    tmp.build_sorted(first, last, checked);
+    swap_links(tmp);
+    pool_.swap(tmp.pool_, std::false_type());
+  }
+  // inserts [first, last); into an empty tree a sorted forward range is
+  // built in O(n) by assign_sorted
+  template <typename InputIt> void insert_range(InputIt first, InputIt last) {
+    using category = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+      auto less = [this](const auto &a, const auto &b) {
+        return comp_(KeyOfValue()(a), KeyOfValue()(b));
+      };
+      if (!root_ && std::is_sorted(first, last, less)) {
+        assign_sorted(first, last);
+        return;
+      }
+    }
+    for (; first != last; ++first)
+      emplace(*first);
+  }
+  // Moves every element of other whose key is missing here by relinking
+  // its node; elements with keys present here stay in other. With equal
+  // allocators nothing is copied or allocated per element, otherwise the
+  // moved elements are copied over.
+  void merge(RBTree &other) {
+    if (this == &other || !other.root_)
+      return;
+    bool splice = get_allocator() == other.get_allocator();
+    if (splice)
+      pool_.adopt_slabs(other.pool_);
+    for (NodeBase *i = other.head_.left_; i != other.header();) {
+      NodeBase *next = next_node(i);
+      Position pos = locate(key_of(i));
+      if (!pos.found) {
+        if (splice) {
+          other.unlink_node(i);
+          other.pool_.disown(1);
+          pool_.adopt(1);
+          relink(static_cast<Node *>(i), pos);
         } else {
-          x->parent_->right_ = nullptr;
-          rebalance_left_subtree(x);
+          emplace_at(pos, static_cast<Node *>(i)->value());
+          other.delete_node(i);
         }
-      } else {
-        root_ = nullptr;
       }
-      delete x;
-      --node_count_;
-      update_head();
+      i = next;
+    }
+  }
+  // takes the element out of the tree without destroying or moving it
+  NodeHandle extract(iterator pos) {
+    Node *x = static_cast<Node *>(pos.node_);
+    std::shared_ptr<void> slabs = pool_.store_of(x);
+    unlink_node(x);
+    pool_.disown(1);
+    return NodeHandle(x, std::move(slabs), get_allocator());
+  }
+  // Links the handle's node unless its key is present, in which case the
+  // handle keeps it. The handle must come from a tree with an equal
+  // allocator.
+  std::pair<Node *, bool> insert(NodeHandle &handle) {
+    if (handle.empty())
+      return {nullptr, false};
+    Position pos = locate(handle.node_->key());
+    if (pos.found)
+      return {static_cast<Node *>(pos.node), false};
+    pool_.adopt_slabs(handle.slabs_);
+    Node *x = handle.release();
+    pool_.adopt(1);
+    // the key may have been changed through the handle
+    cache_key(x);
+    relink(x, pos);
+    return {x, true};
+  }
+  // Erases [first, last) by cutting the tree in front of first and of
+  // last and joining what stays; O(log n) plus freeing the elements, with
+  // no rebalancing per element.
+  void erase(iterator first, iterator last) noexcept {
+    if (first == last)
+      return;
+    Piece below, rest, doomed, above;
+    NodeBase *from = split({root_, black_height()}, key_of(first.node_),
+                           below, rest);
+    NodeBase *to = nullptr;
+    if (last.node_ == header())
+      doomed = rest;
+    else
+      to = split(rest, key_of(last.node_), doomed, above);
+    size_type before = node_count_;
+    free_tree_memory(doomed.root);
+    destroy_node(static_cast<Node *>(from));
+    --node_count_;
+    set_root(to ? join(below, to, above).root : below.root);
+    churn_ += before - node_count_;
+  }
+  // erases every element whose key is less than key
+  void erase_before(const key_type &key) noexcept {
+    Piece below, above;
+    NodeBase *at = split({root_, black_height()}, key, below, above);
+    size_type before = node_count_;
+    free_tree_memory(below.root);
+    set_root(at ? join({nullptr, 0}, at, above).root : above.root);
+    churn_ += before - node_count_;
+  }
+  // erases every element whose key is greater than key
+  void erase_after(const key_type &key) noexcept {
+    Piece below, above;
+    NodeBase *at = split({root_, black_height()}, key, below, above);
+    size_type before = node_count_;
+    free_tree_memory(above.root);
+    set_root(at ? join(below, at, {nullptr, 0}).root : below.root);
+    churn_ += before - node_count_;
+  }
+  // Moves the elements whose keys are not less than key to right, which
+  // must have an equal allocator; whatever right held is destroyed first.
+  // The cut is O(log n); sizing the halves walks the smaller one.
+  void split(const key_type &key, RBTree &right) {
+    if (this == &right)
+      return;
+    right.delete_tree();
+    right.pool_.adopt_slabs(pool_);
+    right.comp_ = comp_;
+    Piece below, above;
+    NodeBase *at = split({root_, black_height()}, key, below, above);
+    if (at)
+      above = join({nullptr, 0}, at, above);
+    size_type kept = piece_size(below.root, above.root, node_count_);
+    right.set_root(above.root);
+    right.node_count_ = node_count_ - kept;
+    set_root(below.root);
+    node_count_ = kept;
+    pool_.disown(right.node_count_);
+    right.pool_.adopt(right.node_count_);
+  }
+  // Moves every element of other here in O(log n). All keys of other must
+  // be greater than every key here, or all less; otherwise nothing changes
+  // and std::invalid_argument is thrown. With unequal allocators the
+  // elements are copied instead.
+  void join(RBTree &other) {
+    if (this == &other || !other.root_)
+      return;
+    bool after =
+        !root_ || comp_(key_of(head_.right_), key_of(other.head_.left_));
+    if (!after && !comp_(key_of(other.head_.right_), key_of(head_.left_)))
+      throw std::invalid_argument("join: key ranges overlap");
+    if (get_allocator() != other.get_allocator()) {
+      merge(other);
       return;
     }
+    pool_.adopt_slabs(other.pool_);
+    // the element of other next to the seam joins the two as their middle
+    NodeBase *k = after ? other.head_.left_ : other.head_.right_;
+    other.unlink_node(k);
+    size_type moved = other.node_count_ + 1;
+    Piece mine{root_, black_height()};
+    Piece theirs{other.root_, other.black_height()};
+    set_root(after ? join(mine, k, theirs).root : join(theirs, k, mine).root);
+    node_count_ += moved;
+    other.set_root(nullptr);
+    other.node_count_ = 0;
+    other.pool_.disown(moved);
+    pool_.adopt(moved);
   }
-
-  void update_head() noexcept {
+  // In-place set algebra with other by divide and conquer over join() and
+  // split(): O(m log(n/m + 1)) work for sizes m <= n, the two halves of
+  // each large enough step running on separate threads. Nodes of other
+  // are spliced in or freed, leaving other empty; copied first when the
+  // allocators differ. Compare must be safe to call concurrently.
+  // combine(kept, dropped) folds the value of a dropped duplicate into the
+  // kept one once the tree is whole again.
+  template <typename Combine> void unite(RBTree &other, Combine combine) {
+    set_operation(SetOp::UNION, other, combine);
+  }
+  template <typename Combine> void intersect(RBTree &other, Combine combine) {
+    set_operation(SetOp::INTERSECTION, other, combine);
+  }
+  void subtract(RBTree &other) {
+    auto none = [](value_type &, value_type &) {};
+    set_operation(SetOp::DIFFERENCE, other, none);
+  }
+  // How many levels of the set algebra recursion may fork, for every tree
+  // of this type; -1, the default, derives it from the number of cores and
+  // 0 keeps the work on the calling thread.
+  static void set_parallel_depth(int depth) noexcept {
+    parallel_depth().store(depth, std::memory_order_relaxed);
+  }
+  // Moves the elements of all trees in others into this one in a single
+  // k-way pass: a loser tree streams every tree in key order, an element
+  // whose key was seen before is folded into the first one seen with
+  // combine(kept, dropped) and freed, and the ordered nodes are hung as a
+  // balanced tree as assign_sorted() does. O(N log k) comparisons for N
+  // elements in k trees; nodes are relinked, and elements are only moved
+  // when an allocator differs. The other trees end up empty. If combine
+  // throws nothing has been relinked yet: trees sharing this one's
+  // allocator keep their elements, save values already combined.
+  template <typename Combine>
+  void merge_all(const std::vector<RBTree *> &others, Combine combine) {
+    std::vector<RBTree *> trees{this};
+    std::vector<RBTree> moved;
+    moved.reserve(others.size());
+    size_type total = node_count_;
+    // a tree listed twice, or this one listed, is walked once
+    std::unordered_set<const RBTree *> seen{this};
+    for (RBTree *t : others) {
+      if (!t->root_ || !seen.insert(t).second)
+        continue;
+      if (get_allocator() != t->get_allocator()) {
+        moved.emplace_back(std::move(*t), get_allocator());
+        t = &moved.back();
+      }
+      pool_.adopt_slabs(t->pool_);
+      trees.push_back(t);
+      total += t->node_count_;
+    }
+    std::vector<Node *> nodes, dropped;
+    nodes.reserve(total);
+    // cursor[i] is the next node of trees[i], or nullptr when exhausted;
+    // equal keys are won by the lower index
+    size_type k = trees.size();
+    std::vector<NodeBase *> cursor(k);
+    for (size_type i = 0; i < k; ++i)
+      cursor[i] = trees[i]->root_ ? trees[i]->head_.left_ : nullptr;
+    auto less = [&](size_type a, size_type b) {
+      if (!cursor[a] || !cursor[b])
+        return cursor[a] && !cursor[b];
+      if (comp_(key_of(cursor[a]), key_of(cursor[b])))
+        return true;
+      return a < b && !comp_(key_of(cursor[b]), key_of(cursor[a]));
+    };
+    // inner node n of the tournament keeps the loser of its match; leaf i
+    // sits at k + i
+    std::vector<size_type> loser(k);
+    size_type winner = play(1, k, loser, less);
+    for (NodeBase *x; (x = cursor[winner]);) {
+      NodeBase *next = next_node(x);
+      cursor[winner] = next == trees[winner]->header() ? nullptr : next;
+      Node *node = static_cast<Node *>(x);
+      if (!nodes.empty() && !comp_(nodes.back()->key(), node->key())) {
+        combine(nodes.back()->value(), node->value());
+        dropped.push_back(node);
+      } else {
+        nodes.push_back(node);
+      }
+      for (size_type n = (k + winner) / 2; n > 0; n /= 2)
+        if (less(loser[n], winner))
+          std::swap(loser[n], winner);
+    }
+    for (size_type i = 1; i < k; ++i) {
+      RBTree *t = trees[i];
+      t->pool_.disown(t->node_count_);
+      pool_.adopt(t->node_count_);
+      churn_ += t->node_count_;
+      t->set_root(nullptr);
+      t->node_count_ = 0;
+    }
+    for (Node *x : dropped)
+      destroy_node(x);
+    hang_sorted(nodes);
+    at_edge_ = false;
+  }
+  size_type size() const noexcept { return node_count_; }
+  void swap(RBTree &other) noexcept {
+    swap_links(other);
+    std::swap(comp_, other.comp_);
+    std::swap(compact_after_, other.compact_after_);
+    std::swap(compact_order_, other.compact_order_);
+    pool_.swap(other.pool_,
+               typename alloc_traits::propagate_on_container_swap());
+  }
+  void reserve(size_type n) { pool_.reserve(n); }
+  void shrink_to_fit() { pool_.shrink_to_fit(); }
+  size_type capacity() const noexcept { return pool_.capacity(); }
+  // Relocates every node into a single fresh slab laid out in the given
+  // order and frees the old slabs. Values are moved when that cannot throw
+  // and copied otherwise; if anything throws the tree is left untouched.
+  // Invalidates all iterators.
+  void compact(CompactOrder order = CompactOrder::IN_ORDER) {
+    churn_ = 0;
     if (!root_) {
-      head_->left_ = nullptr;
-      head_->right_ = nullptr;
+      pool_.release();
       return;
     }
-    head_->left_ = min(root_);
-    head_->right_ = max(root_);
-    root_->parent_ = head_;
+    std::vector<NodeBase *> old_nodes = nodes_in(order);
+    NodePool<Node, Allocator> fresh(pool_.get_allocator());
+    fresh.set_budget(pool_.budget());
+    fresh.reserve(node_count_);
+    std::vector<Node *> new_nodes;
+    new_nodes.reserve(node_count_);
+    try {
+      for (NodeBase *x : old_nodes) {
+        Node *y = make_node(
+            fresh, std::move_if_noexcept(static_cast<Node *>(x)->value()));
+        y->set_color(x->color());
+        new_nodes.push_back(y);
+      }
+    } catch (...) {
+      for (Node *y : new_nodes)
+        destroy_node(fresh, y);
+      throw;
+    }
+    // each old node remembers its copy in the parent link while relinking
+    for (size_type i = 0; i < node_count_; ++i)
+      old_nodes[i]->parent_color_ = reinterpret_cast<uintptr_t>(new_nodes[i]);
+    auto moved = [](NodeBase *x) {
+      return reinterpret_cast<NodeBase *>(x->parent_color_);
+    };
+    for (size_type i = 0; i < node_count_; ++i) {
+      NodeBase *x = old_nodes[i], *y = new_nodes[i];
+      y->left_ = x->left_ ? moved(x->left_) : nullptr;
+      y->right_ = x->right_ ? moved(x->right_) : nullptr;
+      if (y->left_)
+        y->left_->set_parent(y);
+      if (y->right_)
+        y->right_->set_parent(y);
+    }
+    root_ = moved(root_);
+    root_->set_parent(&head_);
+    update_head();
+    Allocator alloc(pool_.get_allocator());
+    for (NodeBase *x : old_nodes)
+      alloc_traits::destroy(alloc,
+                            std::addressof(static_cast<Node *>(x)->value()));
+    pool_.swap(fresh, std::false_type());
+  }
+  // compact() runs from auto_compact() once churn inserts and erases have
+  // happened since the last compaction; 0 turns the heuristic off
+  void set_auto_compact(size_type churn,
+                        CompactOrder order = CompactOrder::IN_ORDER) noexcept {
+    compact_after_ = churn;
+    compact_order_ = order;
   }
-  void rebalance_right_subtree(Node *x) noexcept {
-    if (!x || !x->parent_)
+  // a compaction that fails to allocate is skipped, the tree stays as it was
+  void auto_compact() noexcept {
+    if (compact_after_ == 0 || churn_ < compact_after_)
       return;
-    Node *sibling = x->parent_->right_;
-    if (sibling->color_ == BLACK) {
-      // case sibling is black
-      if ((sibling->left_ && sibling->left_->color_ == RED) ||
-          (sibling->right_ && sibling->right_->color_ == RED)) {
-        // case at least 1 child is red
-        if (sibling->right_ && sibling->right_->color_ == RED) {
-          // case right_ child is red, left_ is any
-          sibling->color_ = sibling->parent_->color_;
-          sibling->parent_->color_ = BLACK;
-          sibling->right_->color_ = BLACK;
-          large_left_turn(sibling->right_);
-          return;
-        }
-        if (sibling->left_ && sibling->left_->color_ == RED &&
-            (!sibling->right_ || sibling->right_->color_ == BLACK)) {
-          // case left_ child is red, right_ is black
-          sibling->left_->color_ = BLACK;
-          sibling->color_ = RED;
-          small_right_turn(sibling->left_);
-          rebalance_right_subtree(x);
-          return;
+    try {
+      compact(compact_order_);
+    } catch (...) {
+      churn_ = 0;
+    }
+  }
+  // Checks the red-black rules, key order, parent links, the ends kept in
+  // the header and the element count; meant for tests.
+  bool verify() const noexcept {
+    if (!root_)
+      return node_count_ == 0 && !head_.left_ && !head_.right_;
+    if (is_red(root_) || root_->parent() != header() ||
+        head_.left_ != min(root_) || head_.right_ != max(root_))
+      return false;
+    size_type count = 0;
+    if (black_height_of(root_, count) < 0 || count != node_count_)
+      return false;
+    for (NodeBase *i = head_.left_; i != head_.right_;) {
+      NodeBase *next = next_node(i);
+      if (!comp_(key_of(i), key_of(next)))
+        return false;
+      i = next;
+    }
+    return true;
+  }
+  MemoryUsage memory_usage() const noexcept {
+    size_type nodes = pool_.size() * pool_.slot_size();
+    size_type reserved = std::max(pool_.reserved_bytes(), nodes);
+    return MemoryUsage{nodes, sizeof(NodeBase), reserved - nodes, 0};
+  }
+  void set_memory_budget(std::shared_ptr<MemoryBudget> budget) {
+    pool_.set_budget(std::move(budget));
+  }
+  size_type max_size() const noexcept {
+    return std::numeric_limits<size_type>::max() / sizeof(Node) / 2;
+  }
+  iterator begin() const noexcept { return iterator(min(header())); }
+  iterator end() const noexcept { return iterator(header()); }
+
+private:
+  using alloc_traits = std::allocator_traits<Allocator>;
+
+  template <typename... Args> Node *create_node(Args &&...args) {
+    return make_node(pool_, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  static Node *make_node(NodePool<Node, Allocator> &pool, Args &&...args) {
+    Node *x = pool.allocate();
+    x->parent_color_ = uintptr_t(RED);
+    x->left_ = x->right_ = nullptr;
+    Allocator alloc(pool.get_allocator());
+    try {
+      alloc_traits::construct(alloc, std::addressof(x->value()),
+                              std::forward<Args>(args)...);
+    } catch (...) {
+      pool.deallocate(x);
+      throw;
+    }
+    cache_key(x);
+    return x;
+  }
+  static void cache_key(Node *x) noexcept {
+    if constexpr (prefix_bytes_ > 0)
+      x->cache_prefix(std::string_view(x->key()));
+  }
+  void destroy_node(Node *x) noexcept { destroy_node(pool_, x); }
+  static void destroy_node(NodePool<Node, Allocator> &pool, Node *x) noexcept {
+    Allocator alloc(pool.get_allocator());
+    alloc_traits::destroy(alloc, std::addressof(x->value()));
+    pool.deallocate(x);
+  }
+  template <typename InputIt>
+  void build_sorted(InputIt first, InputIt last, bool checked) {
+    using category = typename std::iterator_traits<InputIt>::iterator_category;
+    std::vector<Node *> nodes;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+      size_type n = static_cast<size_type>(std::distance(first, last));
+      nodes.reserve(n);
+      pool_.reserve(n);
+    }
+    try {
+      for (; first != last; ++first) {
+        Node *x = create_node(*first);
+        if (checked && !nodes.empty()) {
+          bool ordered = !comp_(x->key(), nodes.back()->key());
+          if (!ordered || !comp_(nodes.back()->key(), x->key())) {
+            destroy_node(x);
+            if (!ordered)
+              throw std::invalid_argument("assign_sorted: range not sorted");
+            continue;
+          }
         }
+        nodes.push_back(x);
       }
-      if ((!sibling->left_ || sibling->left_->color_ == BLACK) &&
-          (!sibling->right_ || sibling->right_->color_ == BLACK)) {
-        // case both children are black
-        sibling->color_ = RED;
-        Color prev_color = sibling->parent_->color_;
-        sibling->parent_->color_ = BLACK;
-        if (prev_color == BLACK)
-          rebalance_right_subtree(sibling->parent_);
-      }
-    } else {
-      // case sibling is red
-      sibling->parent_->color_ = RED;
-      sibling->color_ = BLACK;
-      large_left_turn(sibling->right_);
-      rebalance_right_subtree(x);
+    } catch (...) {
+      for (Node *x : nodes)
+        destroy_node(x);
+      throw;
     }
+    hang_sorted(nodes);
   }
-  void rebalance_left_subtree(Node *x) noexcept {
-    if (!x || !x->parent_)
-      return;
-    Node *sibling = x->parent_->left_;
-    if (sibling->color_ == BLACK) {
-      // case sibling is black
-      if ((sibling->right_ && sibling->right_->color_ == RED) ||
-          (sibling->left_ && sibling->left_->color_ == RED)) {
-        // case at least 1 child is red
-        if (sibling->left_ && sibling->left_->color_ == RED) {
-          // case left_ child is red, right_ is any
-          sibling->color_ = sibling->parent_->color_;
-          sibling->parent_->color_ = BLACK;
-          sibling->left_->color_ = BLACK;
-          large_right_turn(sibling->left_);
-          return;
-        }
-        if (sibling->right_ && sibling->right_->color_ == RED &&
-            (!sibling->left_ || sibling->left_->color_ == BLACK)) {
-          // case right_ child is red, left_ is black
-          sibling->right_->color_ = BLACK;
-          sibling->color_ = RED;
-          small_left_turn(sibling->right_);
-          rebalance_left_subtree(x);
-          return;
-        }
+  // makes the tree the sorted nodes, replacing whatever links they had
+  void hang_sorted(const std::vector<Node *> &nodes) noexcept {
+    size_type full_levels = 0;
+    while ((size_type(2) << full_levels) - 1 <= nodes.size())
+      ++full_levels;
+    root_ = hang_balanced(nodes, 0, nodes.size(), 0, full_levels);
+    if (root_)
+      root_->set_parent(&head_);
+    node_count_ = nodes.size();
+    update_head();
+  }
+  // Links nodes[lo, hi) into a balanced subtree. Only the deepest level can
+  // be incomplete; its nodes are red and all others black, so every path
+  // has the same black height.
+  static NodeBase *hang_balanced(const std::vector<Node *> &nodes, size_type lo,
+                                 size_type hi, size_type depth,
+                                 size_type red_depth) noexcept {
+    if (lo == hi)
+      return nullptr;
+    size_type mid = lo + (hi - lo) / 2;
+    NodeBase *x = nodes[mid];
+    x->left_ = hang_balanced(nodes, lo, mid, depth + 1, red_depth);
+    x->right_ = hang_balanced(nodes, mid + 1, hi, depth + 1, red_depth);
+    if (x->left_)
+      x->left_->set_parent(x);
+    if (x->right_)
+      x->right_->set_parent(x);
+    x->set_color(depth == red_depth ? RED : BLACK);
+    return x;
+  }
+  // locate() within the subtree at from, which must be able to hold key
+  template <typename K>
+  Position descend(NodeBase *from, const K &key) const {
+    if constexpr (three_way_v<K>) {
+      NodeBase *parent = from;
+      bool to_left = true;
+      const auto &probe = probe_of(key);
+      for (NodeBase *i = from; i; i = to_left ? i->left_ : i->right_) {
+        int c = order(probe, i);
+        if (c == 0)
+          return {i, true, false};
+        parent = i;
+        to_left = c < 0;
       }
-      if ((!sibling->right_ || sibling->right_->color_ == BLACK) &&
-          (!sibling->left_ || sibling->left_->color_ == BLACK)) {
-        // case both children are black
-        sibling->color_ = RED;
-        Color prev_color = sibling->parent_->color_;
-        sibling->parent_->color_ = BLACK;
-        if (prev_color == BLACK)
-          rebalance_left_subtree(sibling->parent_);
+      return {parent, false, to_left};
+    }
+    NodeBase *parent = from;
+    NodeBase *candidate = nullptr;
+    bool to_left = true;
+    for (NodeBase *i = from; i;) {
+      parent = i;
+      to_left = comp_(key, key_of(i));
+      if (to_left) {
+        i = i->left_;
+      } else {
+        candidate = i;
+        i = i->right_;
+      }
+    }
+    if (candidate && !comp_(key_of(candidate), key))
+      return {candidate, true, false};
+    return {parent, false, to_left};
+  }
+  // hangs an unlinked node at pos as a fresh red leaf and rebalances
+  void relink(Node *x, const Position &pos) noexcept {
+    x->parent_color_ = uintptr_t(RED);
+    x->left_ = x->right_ = nullptr;
+    fix(link_node(x, pos.node, pos.to_left));
+  }
+  // Destroys the subtree at root without recursion: a left child is
+  // rotated up until the top node has none, then the top node is freed and
+  // its right subtree is next. Stops after steps nodes, leaving root at
+  // what remains; returns the number of nodes freed.
+  static size_type free_nodes(NodePool<Node, Allocator> &pool,
+                              NodeBase *&root, size_type &steps) noexcept {
+    size_type freed = 0;
+    for (; root && steps; --steps) {
+      NodeBase *x = root;
+      if (x->left_) {
+        root = x->left_;
+        x->left_ = root->right_;
+        root->right_ = x;
+      } else {
+        root = x->right_;
+        destroy_node(pool, static_cast<Node *>(x));
+        ++freed;
       }
+    }
+    return freed;
+  }
+  std::vector<NodeBase *> nodes_in(CompactOrder order) const {
+    std::vector<NodeBase *> nodes;
+    nodes.reserve(node_count_);
+    if (!root_)
+      return nodes;
+    if (order == CompactOrder::IN_ORDER) {
+      for (NodeBase *i = head_.left_; i != header(); i = next_node(i))
+        nodes.push_back(i);
     } else {
-      // case sibling is red
-      sibling->parent_->color_ = RED;
-      sibling->color_ = BLACK;
-      large_right_turn(sibling->left_);
-      rebalance_left_subtree(x);
+      nodes.push_back(root_);
+      for (size_type i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]->left_)
+          nodes.push_back(nodes[i]->left_);
+        if (nodes[i]->right_)
+          nodes.push_back(nodes[i]->right_);
+      }
     }
+    return nodes;
   }
-  static Node *next_node(Node *x) {
-    if (x->right_) {
-      x = min(x->right_);
-      return x;
+  // A subtree cut loose by split(), with its black height: the black
+  // nodes on a path from its root, included, down to a null link.
+  struct Piece {
+    NodeBase *root;
+    int height;
+  };
+  int black_height() const noexcept {
+    int height = 0;
+    for (NodeBase *i = root_; i; i = i->left_)
+      height += !is_red(i);
+    return height;
+  }
+  // makes root the root of the tree; the size is up to the caller
+  void set_root(NodeBase *root) noexcept {
+    root_ = root;
+    if (root_) {
+      root_->set_parent(&head_);
+      root_->set_color(BLACK);
     }
-    if (x->parent_->left_ == x) {
-      x = x->parent_;
-      return x;
+    at_edge_ = false;
+    update_head();
+  }
+  // Links l, k and r, with every key of l below k's and every key of r
+  // above, into one valid subtree. k goes down the spine of the taller
+  // piece to where the black heights meet and is fixed up from there, so
+  // the cost is the height difference. root_ serves as scratch.
+  Piece join(Piece l, NodeBase *k, Piece r) noexcept {
+    for (Piece *p : {&l, &r}) {
+      if (is_red(p->root)) {
+        p->root->set_color(BLACK);
+        ++p->height;
+      }
     }
-    Node *nextNode = x;
-    for (; nextNode && max(nextNode) == x; nextNode = nextNode->parent_) {
+    k->parent_color_ = uintptr_t(RED);
+    if (l.height == r.height) {
+      k->set_color(BLACK);
+      k->left_ = l.root;
+      k->right_ = r.root;
+      for (NodeBase *child : {l.root, r.root})
+        if (child)
+          child->set_parent(k);
+      return {k, l.height + 1};
     }
-    if (!nextNode) {
-      for (nextNode = x; nextNode->parent_; nextNode = nextNode->parent_) {
+    bool into_left = l.height > r.height;
+    Piece &tall = into_left ? l : r;
+    Piece &low = into_left ? r : l;
+    root_ = tall.root;
+    root_->set_parent(&head_);
+    NodeBase *parent = nullptr;
+    NodeBase *c = tall.root;
+    for (int h = tall.height; is_red(c) || h > low.height;) {
+      h -= !is_red(c);
+      parent = c;
+      c = into_left ? c->right_ : c->left_;
+    }
+    (into_left ? parent->right_ : parent->left_) = k;
+    (into_left ? k->left_ : k->right_) = c;
+    (into_left ? k->right_ : k->left_) = low.root;
+    k->set_parent(parent);
+    if (c)
+      c->set_parent(k);
+    if (low.root)
+      low.root->set_parent(k);
+    fix_up(k);
+    Piece res{root_, tall.height};
+    if (is_red(root_)) {
+      root_->set_color(BLACK);
+      ++res.height;
+    }
+    return res;
+  }
+  // Cuts t into the keys below key, l, and those above it, r, joining the
+  // pieces hanging off the search path bottom-up; the joins cost O(log n)
+  // in all. Returns the node holding key, unlinked, or nullptr.
+  NodeBase *split(Piece t, const key_type &key, Piece &l, Piece &r) noexcept {
+    constexpr int kMaxDepth = 2 * std::numeric_limits<size_type>::digits;
+    NodeBase *path[kMaxDepth];
+    int below[kMaxDepth];
+    bool to_left[kMaxDepth];
+    int depth = 0;
+    NodeBase *at = nullptr;
+    l = r = {nullptr, 0};
+    for (NodeBase *i = t.root; i;) {
+      int h = t.height - !is_red(i);
+      if (comp_(key, key_of(i))) {
+        to_left[depth] = true;
+      } else if (comp_(key_of(i), key)) {
+        to_left[depth] = false;
+      } else {
+        at = i;
+        l = {i->left_, h};
+        r = {i->right_, h};
+        break;
       }
+      path[depth] = i;
+      below[depth++] = h;
+      i = to_left[depth - 1] ? i->left_ : i->right_;
+      t.height = h;
     }
-    x = nextNode;
-    return x;
+    while (depth-- > 0) {
+      NodeBase *p = path[depth];
+      if (to_left[depth])
+        r = join(r, p, {p->right_, below[depth]});
+      else
+        l = join({p->left_, below[depth]}, p, l);
+    }
+    return at;
   }
-  static Node *prev_node(Node *x) {
-    if (!x->parent_)
-      return x->right_;
-    if (x->left_) {
-      x = max(x->left_);
-      return x;
+  // joins l and r, all of l below r, taking the maximum of l as the middle
+  Piece join(Piece l, Piece r) noexcept {
+    if (!l.root)
+      return r;
+    if (!r.root)
+      return l;
+    Piece rest, none;
+    NodeBase *k = split(l, key_of(max(l.root)), rest, none);
+    return join(rest, k, r);
+  }
+
+  enum class SetOp { UNION, INTERSECTION, DIFFERENCE };
+  // Nodes dropped by a set operation, chained through their parent links:
+  // whole subtrees in trash, and in dups duplicates whose left_ names the
+  // node they matched.
+  struct Dropped {
+    NodeBase *trash = nullptr;
+    NodeBase *trash_tail = nullptr;
+    NodeBase *dups = nullptr;
+    NodeBase *dups_tail = nullptr;
+
+    static void push(NodeBase *&head, NodeBase *&tail, NodeBase *x) noexcept {
+      x->parent_color_ = reinterpret_cast<uintptr_t>(head);
+      head = x;
+      if (!tail)
+        tail = x;
     }
-    if (x->parent_->right_ == x) {
-      x = x->parent_;
-      return x;
+    void drop(NodeBase *subtree) noexcept {
+      if (subtree)
+        push(trash, trash_tail, subtree);
+    }
+    void drop_dup(NodeBase *x, NodeBase *match) noexcept {
+      x->left_ = match;
+      x->right_ = nullptr;
+      push(dups, dups_tail, x);
+    }
+    static void append(NodeBase *&head, NodeBase *&tail, NodeBase *other_head,
+                       NodeBase *other_tail) noexcept {
+      if (!other_head)
+        return;
+      if (tail)
+        tail->parent_color_ = reinterpret_cast<uintptr_t>(other_head);
+      else
+        head = other_head;
+      tail = other_tail;
+    }
+    void append(const Dropped &other) noexcept {
+      append(trash, trash_tail, other.trash, other.trash_tail);
+      append(dups, dups_tail, other.dups, other.dups_tail);
+    }
+  };
+  // a set operation's result on two pieces; matches counts the keys found
+  // in both
+  struct Outcome {
+    Piece piece;
+    size_type matches;
+    Dropped dropped;
+  };
+  // pieces below this black height (a few hundred nodes) are not worth
+  // a thread
+  static constexpr int kParallelHeight = 8;
+  static std::atomic<int> &parallel_depth() noexcept {
+    static std::atomic<int> depth{-1};
+    return depth;
+  }
+
+  template <typename Combine>
+  void set_operation(SetOp op, RBTree &other, Combine &combine) {
+    if (this == &other) {
+      if (op == SetOp::DIFFERENCE)
+        delete_tree();
+      return;
+    }
+    if (get_allocator() != other.get_allocator()) {
+      RBTree copy(other, get_allocator());
+      other.delete_tree();
+      set_operation(op, copy, combine);
+      return;
+    }
+    pool_.adopt_slabs(other.pool_);
+    other.pool_.disown(other.node_count_);
+    pool_.adopt(other.node_count_);
+    size_type mine = node_count_, theirs = other.node_count_;
+    int spawn = parallel_depth().load(std::memory_order_relaxed);
+    if (spawn < 0) {
+      // about two tasks per core even out halves of unequal work
+      unsigned cores = std::thread::hardware_concurrency();
+      spawn = cores > 1 ? 1 : 0;
+      for (; cores > 1; cores /= 2)
+        ++spawn;
+    }
+    Outcome res = combine_pieces(op, {root_, black_height()},
+                                 {other.root_, other.black_height()}, spawn);
+    other.set_root(nullptr);
+    other.node_count_ = 0;
+    set_root(res.piece.root);
+    node_count_ = op == SetOp::UNION          ? mine + theirs - res.matches
+                  : op == SetOp::INTERSECTION ? res.matches
+                                              : mine - res.matches;
+    churn_ += mine + theirs - node_count_;
+    NodeBase *dup = res.dropped.dups;
+    try {
+      for (; dup; dup = next_dropped(dup))
+        combine(static_cast<Node *>(dup->left_)->value(),
+                static_cast<Node *>(dup)->value());
+    } catch (...) {
+      free_dropped(res.dropped.trash, res.dropped.dups);
+      throw;
+    }
+    free_dropped(res.dropped.trash, res.dropped.dups);
+  }
+  // black height of the subtree at x, or -1 if it breaks a rule
+  static int black_height_of(const NodeBase *x, size_type &count) noexcept {
+    if (!x)
+      return 0;
+    ++count;
+    for (const NodeBase *child : {x->left_, x->right_}) {
+      if (child && (child->parent() != x || (is_red(x) && is_red(child))))
+        return -1;
+    }
+    int l = black_height_of(x->left_, count);
+    int r = black_height_of(x->right_, count);
+    if (l < 0 || l != r)
+      return -1;
+    return l + !is_red(x);
+  }
+  static NodeBase *next_dropped(NodeBase *x) noexcept {
+    return reinterpret_cast<NodeBase *>(x->parent_color_);
+  }
+  void free_dropped(NodeBase *trash, NodeBase *dups) noexcept {
+    size_type steps = std::numeric_limits<size_type>::max();
+    for (NodeBase *next; dups; dups = next) {
+      next = next_dropped(dups);
+      dups->left_ = nullptr;
+      free_nodes(pool_, dups, steps);
     }
-    Node *prevNode = x;
-    for (; prevNode && min(prevNode) == x; prevNode = prevNode->parent_) {
+    for (NodeBase *next; trash; trash = next) {
+      next = next_dropped(trash);
+      free_nodes(pool_, trash, steps);
     }
-    if (!prevNode) {
-      for (prevNode = x; prevNode->parent_; prevNode = prevNode->parent_) {
+  }
+  // One step of the divide and conquer: the root of one piece splits the
+  // other, the halves are combined recursively, the second one on its own
+  // thread while spawn lasts, and the results are joined around the root.
+  Outcome combine_pieces(SetOp op, Piece a, Piece b, int spawn) noexcept {
+    Outcome res{{nullptr, 0}, 0, {}};
+    if (!a.root || !b.root) {
+      if (op == SetOp::UNION || (op == SetOp::DIFFERENCE && a.root)) {
+        res.piece = a.root ? a : b;
+      } else {
+        res.dropped.drop(a.root);
+        res.dropped.drop(b.root);
       }
+      return res;
     }
-    x = prevNode;
-    return x;
+    // difference splits what stays by the root of what is taken away
+    bool pivot_a = op != SetOp::DIFFERENCE;
+    Piece &pivot_piece = pivot_a ? a : b;
+    NodeBase *k = pivot_piece.root;
+    int h = pivot_piece.height - !is_red(k);
+    Piece kl{k->left_, h}, kr{k->right_, h}, sl, sr;
+    NodeBase *dup = split(pivot_a ? b : a, key_of(k), sl, sr);
+    Piece al = pivot_a ? kl : sl, ar = pivot_a ? kr : sr;
+    Piece bl = pivot_a ? sl : kl, br = pivot_a ? sr : kr;
+    Outcome l, r;
+    bool forked = false;
+    if (spawn > 0 && std::min(a.height, b.height) >= kParallelHeight) {
+      try {
+        auto right = std::async(std::launch::async, [&] {
+          RBTree scratch(comp_, get_allocator());
+          Outcome o = scratch.combine_pieces(op, ar, br, spawn - 1);
+          scratch.root_ = nullptr;
+          return o;
+        });
+        l = combine_pieces(op, al, bl, spawn - 1);
+        r = right.get();
+        forked = true;
+      } catch (...) {
+      }
+    }
+    if (!forked) {
+      l = combine_pieces(op, al, bl, spawn);
+      r = combine_pieces(op, ar, br, spawn);
+    }
+    res.matches = l.matches + r.matches + (dup ? 1 : 0);
+    res.dropped = l.dropped;
+    res.dropped.append(r.dropped);
+    if (op == SetOp::DIFFERENCE) {
+      k->left_ = k->right_ = nullptr;
+      res.dropped.drop(k);
+      if (dup) {
+        dup->left_ = dup->right_ = nullptr;
+        res.dropped.drop(dup);
+      }
+      res.piece = join(l.piece, r.piece);
+    } else if (dup) {
+      res.dropped.drop_dup(dup, k);
+      res.piece = join(l.piece, k, r.piece);
+    } else if (op == SetOp::UNION) {
+      res.piece = join(l.piece, k, r.piece);
+    } else {
+      k->left_ = k->right_ = nullptr;
+      res.dropped.drop(k);
+      res.piece = join(l.piece, r.piece);
+    }
+    return res;
   }
-  void merge(RBTree &other) noexcept {
-    for (auto i = other.begin(); i != other.end(); ++i) {
-      insert(i.node_->key_, i.node_->value_);
+  // plays the tournament below node n of merge_all's loser tree, for k
+  // leaves, and returns the winner
+  template <typename Less>
+  static size_type play(size_type n, size_type k, std::vector<size_type> &loser,
+                        Less &less) {
+    if (n >= k)
+      return n - k;
+    size_type a = play(2 * n, k, loser, less);
+    size_type b = play(2 * n + 1, k, loser, less);
+    bool a_wins = less(a, b);
+    loser[n] = a_wins ? b : a;
+    return a_wins ? a : b;
+  }
+  // the node after x within a piece whose root has no parent, or nullptr
+  static NodeBase *piece_next(NodeBase *x) noexcept {
+    if (x->right_)
+      return min(x->right_);
+    NodeBase *p = x->parent();
+    for (; p && p->right_ == x; x = p, p = p->parent()) {
     }
-    other.delete_tree();
+    return p;
   }
-  size_type size() const noexcept { return node_count_; }
-  void swap(RBTree &other) noexcept {
-    std::swap(head_, other.head_);
+  // Size of piece a, where pieces a and b hold total nodes together. Both
+  // are walked in step, so the cost is the size of the smaller one.
+  static size_type piece_size(NodeBase *a, NodeBase *b,
+                              size_type total) noexcept {
+    NodeBase *i = a ? min(a) : nullptr;
+    NodeBase *j = b ? min(b) : nullptr;
+    if (a)
+      a->set_parent(nullptr);
+    if (b)
+      b->set_parent(nullptr);
+    size_type steps = 0;
+    for (; i && j; ++steps) {
+      i = piece_next(i);
+      j = piece_next(j);
+    }
+    return i ? total - steps : steps;
+  }
+  NodeBase *header() const noexcept { return const_cast<NodeBase *>(&head_); }
+  // exchanges the node graphs, the pools are handled by the caller
+  void swap_links(RBTree &other) noexcept {
     std::swap(root_, other.root_);
     std::swap(node_count_, other.node_count_);
+    std::swap(head_.left_, other.head_.left_);
+    std::swap(head_.right_, other.head_.right_);
+    if (root_)
+      root_->set_parent(&head_);
+    if (other.root_)
+      other.root_->set_parent(&other.head_);
   }
-  size_type max_size() const noexcept {
-    return std::numeric_limits<size_type>::max() / sizeof(Node) / 2;
+  // Clones other node for node, shape and colours included, into a single
+  // slab without comparing or rebalancing. Walks in preorder through the
+  // parent links, so no stack is needed; a node's copy is finished once
+  // both of its children have copies. On failure the copies are freed.
+  void copy_from(const RBTree &other) {
+    if (!other.root_)
+      return;
+    pool_.reserve(other.size());
+    try {
+      root_ = clone_node(other.root_, &head_);
+      const NodeBase *from = other.root_;
+      NodeBase *to = root_;
+      for (;;) {
+        if (from->left_ && !to->left_) {
+          to->left_ = clone_node(from->left_, to);
+          from = from->left_;
+          to = to->left_;
+        } else if (from->right_ && !to->right_) {
+          to->right_ = clone_node(from->right_, to);
+          from = from->right_;
+          to = to->right_;
+        } else if (from != other.root_) {
+          from = from->parent();
+          to = to->parent();
+        } else {
+          break;
+        }
+      }
+    } catch (...) {
+      delete_tree();
+      throw;
+    }
+    update_head();
+  }
+  Node *clone_node(const NodeBase *from, NodeBase *parent) {
+    Node *x = create_node(static_cast<const Node *>(from)->value());
+    x->set_parent(parent);
+    x->set_color(from->color());
+    ++node_count_;
+    return x;
+  }
+  void move_from(RBTree &other) {
+    pool_.reserve(other.size());
+    for (auto i = other.begin(); i != other.end(); ++i) {
+      fix(insert_non_uniq(std::move(static_cast<Node *>(i.node_)->value())));
+    }
+    other.delete_tree();
   }
-  iterator begin() const noexcept { return iterator(min(head_)); }
-  iterator end() const noexcept { return iterator(head_); }
 
-private:
   // data
-  Node *head_;
-  Node *root_;
+  NodeBase head_;
+  NodeBase *root_;
   size_type node_count_;
   Compare comp_;
+  NodePool<Node, Allocator> pool_;
+  size_type churn_;
+  size_type compact_after_;
+  CompactOrder compact_order_;
+  bool at_edge_; // the last node linked became the minimum or maximum
 };
 } // namespace s21
 #endif // RBTREE_H_
@@ -0,0 +1,71 @@
+#ifndef S21_RECLAIMER_H_
+#define S21_RECLAIMER_H_
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+namespace s21 {
+// Destroys whatever is posted to it on a worker thread, so dropping a huge
+// container does not stall the caller. Typically fed by clear_deferred();
+// the destructor waits until everything posted has been freed.
+class Reclaimer {
+public:
+  Reclaimer() : stop_(false), busy_(false), worker_([this] { run(); }) {}
+  Reclaimer(const Reclaimer &) = delete;
+  Reclaimer &operator=(const Reclaimer &) = delete;
+  ~Reclaimer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+  }
+
+  template <typename Garbage> void post(Garbage &&garbage) {
+    std::shared_ptr<void> held =
+        std::make_shared<std::decay_t<Garbage>>(std::forward<Garbage>(garbage));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(std::move(held));
+    }
+    wake_.notify_all();
+  }
+  // blocks until everything posted so far has been freed
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      std::shared_ptr<void> garbage = std::move(queue_.front());
+      queue_.pop_front();
+      busy_ = true;
+      lock.unlock();
+      garbage.reset();
+      lock.lock();
+      busy_ = false;
+      if (queue_.empty())
+        idle_.notify_all();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::deque<std::shared_ptr<void>> queue_;
+  bool stop_;
+  bool busy_;
+  std::thread worker_;
+};
+} // namespace s21
+#endif // S21_RECLAIMER_H_
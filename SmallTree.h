@@ -0,0 +1,297 @@
+#ifndef S21_SMALL_TREE_H_
+#define S21_SMALL_TREE_H_
+#include "RBTree.h"
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+namespace s21 {
+// Ordered unique storage for containers that usually stay tiny. The first N
+// values live in a buffer inside the object; a byte index keeps them sorted
+// so the values themselves never move, and lookups bisect that index. The
+// insertion that would exceed N moves every value into an RBTree, which
+// stays in use until clear(). That move invalidates iterators and
+// references; nothing else does.
+template <typename Key, typename T, typename KeyOfValue, typename Compare,
+          size_t N, typename Allocator>
+class SmallTree {
+  static_assert(N > 0 && N <= 64, "inline capacity must be within 1..64");
+  using tree_type = RBTree<Key, T, KeyOfValue, Compare, Allocator>;
+  using tree_iterator = typename tree_type::iterator;
+  using alloc_traits = std::allocator_traits<Allocator>;
+
+public:
+  using key_type = Key;
+  using value_type = T;
+  using size_type = size_t;
+  using allocator_type = Allocator;
+
+  template <bool Const> class basic_iterator {
+    friend SmallTree;
+
+  public:
+    using reference = std::conditional_t<Const, const T &, T &>;
+
+    basic_iterator() : owner_(nullptr), pos_(0) {}
+    template <bool C = Const, typename = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false> &other)
+        : owner_(other.owner_), pos_(other.pos_), it_(other.it_) {}
+    reference operator*() const noexcept {
+      return owner_->promoted_ ? *it_ : owner_->value_at(pos_);
+    }
+    basic_iterator &operator++() noexcept {
+      if (owner_->promoted_)
+        ++it_;
+      else
+        ++pos_;
+      return *this;
+    }
+    basic_iterator &operator--() noexcept {
+      if (owner_->promoted_)
+        --it_;
+      else
+        --pos_;
+      return *this;
+    }
+    basic_iterator operator++(int) noexcept {
+      basic_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+    basic_iterator operator--(int) noexcept {
+      basic_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+    bool operator==(const basic_iterator &other) const noexcept {
+      return pos_ == other.pos_ && it_ == other.it_;
+    }
+    bool operator!=(const basic_iterator &other) const noexcept {
+      return !(*this == other);
+    }
+
+  private:
+    basic_iterator(const SmallTree *owner, size_type pos)
+        : owner_(owner), pos_(pos), it_(owner->tree_.end()) {}
+    basic_iterator(const SmallTree *owner, tree_iterator it)
+        : owner_(owner), pos_(0), it_(it) {}
+    const SmallTree *owner_;
+    size_type pos_;
+    tree_iterator it_;
+  };
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  SmallTree() : SmallTree(Compare(), Allocator()) {}
+  explicit SmallTree(const Compare &comp, const Allocator &alloc = Allocator())
+      : order_{}, used_(0), small_size_(0), promoted_(false), comp_(comp),
+        tree_(comp, alloc) {}
+  SmallTree(const SmallTree &other)
+      : order_{}, used_(0), small_size_(0), promoted_(other.promoted_),
+        comp_(other.comp_), tree_(other.tree_) {
+    copy_inline(other);
+  }
+  SmallTree(SmallTree &&other) noexcept(
+      std::is_nothrow_move_constructible<T>::value)
+      : order_{}, used_(0), small_size_(0), promoted_(other.promoted_),
+        comp_(other.comp_), tree_(std::move(other.tree_)) {
+    move_inline(other);
+  }
+  SmallTree &operator=(const SmallTree &other) {
+    if (this == &other)
+      return *this;
+    clear();
+    comp_ = other.comp_;
+    tree_ = other.tree_;
+    promoted_ = other.promoted_;
+    copy_inline(other);
+    return *this;
+  }
+  SmallTree &operator=(SmallTree &&other) {
+    if (this == &other)
+      return *this;
+    clear();
+    comp_ = other.comp_;
+    tree_ = std::move(other.tree_);
+    promoted_ = other.promoted_;
+    move_inline(other);
+    return *this;
+  }
+  ~SmallTree() { destroy_inline(); }
+
+  allocator_type get_allocator() const { return tree_.get_allocator(); }
+  iterator begin() const noexcept {
+    return promoted_ ? iterator(this, tree_.begin()) : iterator(this, 0);
+  }
+  iterator end() const noexcept {
+    return promoted_ ? iterator(this, tree_.end())
+                     : iterator(this, small_size_);
+  }
+  size_type size() const noexcept {
+    return promoted_ ? tree_.size() : small_size_;
+  }
+  size_type max_size() const noexcept { return tree_.max_size(); }
+  bool is_inline() const noexcept { return !promoted_; }
+
+  iterator find(const key_type &key) const noexcept {
+    if (promoted_)
+      return iterator(this, tree_.find(key));
+    size_type pos = lower_bound(key);
+    if (pos < small_size_ && !comp_(key, key_at(pos)))
+      return iterator(this, pos);
+    return end();
+  }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    return try_emplace(KeyOfValue()(value), value);
+  }
+  // one search finds key or its place; the value is built from args only
+  // when key is absent
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type &key, Args &&...args) {
+    if (!promoted_) {
+      size_type pos = lower_bound(key);
+      if (pos < small_size_ && !comp_(key, key_at(pos)))
+        return {iterator(this, pos), false};
+      if (small_size_ < N) {
+        place(pos, std::forward<Args>(args)...);
+        return {iterator(this, pos), true};
+      }
+      promote();
+    }
+    auto res = tree_.try_emplace(key, std::forward<Args>(args)...);
+    return {iterator(this, tree_iterator(res.first)), res.second};
+  }
+  iterator erase(iterator pos) noexcept {
+    if (promoted_) {
+      tree_iterator next = pos.it_;
+      ++next;
+      tree_.delete_node(pos.it_);
+      return iterator(this, next);
+    }
+    unsigned char slot = order_[pos.pos_];
+    Allocator alloc(tree_.get_allocator());
+    alloc_traits::destroy(alloc, slot_ptr(slot));
+    used_ &= ~(uint64_t(1) << slot);
+    --small_size_;
+    for (size_type i = pos.pos_; i < small_size_; ++i)
+      order_[i] = order_[i + 1];
+    return pos;
+  }
+  // moves over the values whose keys are not here yet; the others stay
+  // in other
+  void merge(SmallTree &other) {
+    if (this == &other)
+      return;
+    for (auto i = other.begin(); i != other.end();) {
+      if (try_emplace(KeyOfValue()(*i), std::move_if_noexcept(*i)).second)
+        i = other.erase(i);
+      else
+        ++i;
+    }
+  }
+  // back to inline storage; the tree's slabs are returned as well
+  void clear() noexcept {
+    destroy_inline();
+    tree_.delete_tree();
+    tree_.shrink_to_fit();
+    promoted_ = false;
+  }
+  void swap(SmallTree &other) {
+    SmallTree tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+private:
+  T *slot_ptr(unsigned char slot) const noexcept {
+    return reinterpret_cast<T *>(const_cast<unsigned char *>(slots_[slot]));
+  }
+  T &value_at(size_type pos) const noexcept { return *slot_ptr(order_[pos]); }
+  const key_type &key_at(size_type pos) const noexcept {
+    return KeyOfValue()(value_at(pos));
+  }
+  size_type lower_bound(const key_type &key) const {
+    size_type lo = 0, hi = small_size_;
+    while (lo < hi) {
+      size_type mid = (lo + hi) / 2;
+      if (comp_(key_at(mid), key))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+  // constructs a value from args in the lowest free slot and lists it at
+  // position pos
+  template <typename... Args> void place(size_type pos, Args &&...args) {
+    unsigned char slot = 0;
+    while (used_ & (uint64_t(1) << slot))
+      ++slot;
+    Allocator alloc(tree_.get_allocator());
+    alloc_traits::construct(alloc, slot_ptr(slot), std::forward<Args>(args)...);
+    used_ |= uint64_t(1) << slot;
+    for (size_type i = small_size_; i > pos; --i)
+      order_[i] = order_[i - 1];
+    order_[pos] = slot;
+    ++small_size_;
+  }
+  // moves the inline values into the tree; the tree has all of its room
+  // before the first value moves, so a failure leaves the buffer intact
+  void promote() {
+    tree_.reserve(2 * N);
+    try {
+      for (size_type i = 0; i < small_size_; ++i)
+        tree_.fix(tree_.insert_non_uniq(std::move_if_noexcept(value_at(i))));
+    } catch (...) {
+      tree_.delete_tree();
+      throw;
+    }
+    destroy_inline();
+    promoted_ = true;
+  }
+  void destroy_inline() noexcept {
+    Allocator alloc(tree_.get_allocator());
+    for (size_type i = 0; i < small_size_; ++i)
+      alloc_traits::destroy(alloc, slot_ptr(order_[i]));
+    small_size_ = 0;
+    used_ = 0;
+  }
+  void copy_inline(const SmallTree &other) {
+    try {
+      for (size_type i = 0; i < other.small_size_; ++i)
+        place(i, other.value_at(i));
+    } catch (...) {
+      destroy_inline();
+      throw;
+    }
+  }
+  // keeps every value in its slot so that the index can be copied as is
+  void move_inline(SmallTree &other) {
+    Allocator alloc(tree_.get_allocator());
+    try {
+      for (size_type i = 0; i < other.small_size_; ++i) {
+        unsigned char slot = other.order_[i];
+        alloc_traits::construct(alloc, slot_ptr(slot),
+                                std::move(*other.slot_ptr(slot)));
+        order_[i] = slot;
+        used_ |= uint64_t(1) << slot;
+        small_size_ = i + 1;
+      }
+    } catch (...) {
+      destroy_inline();
+      throw;
+    }
+    other.destroy_inline();
+    other.promoted_ = false;
+  }
+
+  alignas(T) unsigned char slots_[N][sizeof(T)];
+  unsigned char order_[N];
+  uint64_t used_;
+  size_type small_size_;
+  bool promoted_;
+  Compare comp_;
+  tree_type tree_;
+};
+} // namespace s21
+#endif // S21_SMALL_TREE_H_
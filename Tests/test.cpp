@@ -1,6 +1,76 @@
 #include "../map.h"
+#include "../set.h"
+#include "../small_map.h"
+#include "../small_set.h"
+#include "../split_map.h"
 #include <gtest/gtest.h>
 #include <map>
+#include <set>
+
+class CountingResource : public std::pmr::memory_resource {
+public:
+  size_t allocations = 0;
+
+private:
+  void *do_allocate(size_t bytes, size_t align) override {
+    ++allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+struct CopyCounter {
+  static int copies;
+  static int constructions;
+  explicit CopyCounter(int v = 0) : value(v) { ++constructions; }
+  CopyCounter(const CopyCounter &other) : value(other.value) {
+    ++copies;
+    ++constructions;
+  }
+  CopyCounter(CopyCounter &&other) noexcept : value(other.value) {
+    ++constructions;
+  }
+  CopyCounter &operator=(const CopyCounter &) = default;
+  bool operator<(const CopyCounter &other) const {
+    return value < other.value;
+  }
+  int value;
+};
+int CopyCounter::copies = 0;
+int CopyCounter::constructions = 0;
+
+struct CountingLess {
+  static size_t calls;
+  bool operator()(int a, int b) const {
+    ++calls;
+    return a < b;
+  }
+};
+size_t CountingLess::calls = 0;
+
+struct ThrowingCopy {
+  static int copies_left;
+  explicit ThrowingCopy(int v) : value(v) {}
+  ThrowingCopy(const ThrowingCopy &other) : value(other.value) {
+    if (copies_left-- == 0)
+      throw std::runtime_error("copy failed");
+  }
+  int value;
+};
+int ThrowingCopy::copies_left = -1;
+
+struct NoDefaultKey {
+  explicit NoDefaultKey(int v) : value(v) {}
+  bool operator<(const NoDefaultKey &other) const {
+    return value < other.value;
+  }
+  int value;
+};
 TEST(Map, Constructor1) {
   s21::map<int, int> s21_map;
   std::map<int, int> std_map;
@@ -862,6 +932,1250 @@ TEST(Map, OperatorLessUsage) {
     EXPECT_EQ((*s21_i).second, (*std_i).second);
   }
 }
+TEST(Map, ReserveShrink1) {
+  s21::map<int, int> s21_map;
+  std::map<int, int> std_map;
+  s21_map.reserve(1000);
+  for (int i = 0; i < 1000; ++i) {
+    s21_map.insert(i, i * 2);
+    std_map.insert({i, i * 2});
+  }
+  for (int i = 0; i < 1000; i += 3) {
+    s21_map.erase(s21_map.begin());
+    std_map.erase(std_map.begin());
+  }
+  s21_map.shrink_to_fit();
+  EXPECT_EQ(s21_map.size(), std_map.size());
+  auto s21_i = s21_map.begin();
+  for (auto std_i = std_map.begin(); std_i != std_map.end(); ++std_i) {
+    EXPECT_EQ(*s21_i++, *std_i);
+  }
+  s21_map.clear();
+  s21_map.shrink_to_fit();
+  EXPECT_TRUE(s21_map.empty());
+  s21_map[7] = 7;
+  EXPECT_EQ(s21_map.at(7), 7);
+}
+TEST(Map, PmrAllocator1) {
+  char buffer[4096];
+  std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer));
+  s21::pmr::map<int, std::pmr::string> s21_map(&resource);
+  for (int i = 0; i < 10; ++i) {
+    s21_map.insert(i, std::pmr::string(20, char('a' + i)));
+  }
+  EXPECT_EQ(s21_map.get_allocator().resource(), &resource);
+  EXPECT_EQ(s21_map.at(3).get_allocator().resource(), &resource);
+  EXPECT_EQ(s21_map.at(9), std::pmr::string(20, 'j'));
+
+  s21::pmr::map<int, std::pmr::string> s21_map_copy(s21_map);
+  EXPECT_EQ(s21_map_copy.get_allocator().resource(),
+            std::pmr::get_default_resource());
+  EXPECT_EQ(s21_map_copy.at(3).get_allocator().resource(),
+            std::pmr::get_default_resource());
+
+  s21::pmr::map<int, std::pmr::string> s21_map_move(std::move(s21_map));
+  EXPECT_EQ(s21_map_move.get_allocator().resource(), &resource);
+  EXPECT_EQ(s21_map_move.size(), 10U);
+  EXPECT_TRUE(s21_map.empty());
+
+  s21::pmr::map<int, std::pmr::string> s21_map_other(
+      std::move(s21_map_move), std::pmr::get_default_resource());
+  EXPECT_EQ(s21_map_other.at(5).get_allocator().resource(),
+            std::pmr::get_default_resource());
+  EXPECT_EQ(s21_map_other.at(5), std::pmr::string(20, 'f'));
+}
+TEST(Map, PmrAllocator2) {
+  std::pmr::monotonic_buffer_resource first;
+  std::pmr::monotonic_buffer_resource second;
+  s21::pmr::map<int, int> a(&first);
+  s21::pmr::map<int, int> b(&second);
+  a[1] = 1;
+  a[2] = 2;
+  b[3] = 3;
+  b = std::move(a);
+  EXPECT_EQ(b.get_allocator().resource(), &second);
+  EXPECT_EQ(b.size(), 2U);
+  EXPECT_EQ(b.at(2), 2);
+  a = b;
+  EXPECT_EQ(a.get_allocator().resource(), &first);
+  EXPECT_EQ(a.size(), 2U);
+  EXPECT_EQ(a.at(1), 1);
+}
+TEST(Set, PmrAllocator1) {
+  std::pmr::monotonic_buffer_resource resource;
+  s21::pmr::set<std::pmr::string> s21_set(&resource);
+  s21_set.insert("b");
+  s21_set.insert("a");
+  s21_set.insert("b");
+  EXPECT_EQ(s21_set.size(), 2U);
+  EXPECT_EQ(*s21_set.begin(), "a");
+  EXPECT_EQ((*s21_set.begin()).get_allocator().resource(), &resource);
+}
+TEST(Map, NodeFootprint1) {
+  using node = s21::map<std::string, std::string>::node_type;
+  using value = std::pair<const std::string, std::string>;
+  EXPECT_LE(sizeof(node), 4 * sizeof(void *) + sizeof(value));
+}
+TEST(Map, NodeFootprint2) {
+  using node = s21::map<int, int>::node_type;
+  EXPECT_LE(sizeof(node), 3 * sizeof(void *) + sizeof(std::pair<int, int>));
+}
+TEST(Set, NodeFootprint1) {
+  using node = s21::set<std::string>::node_type;
+  EXPECT_LE(sizeof(node), 4 * sizeof(void *) + sizeof(std::string));
+}
+TEST(Map, AllocationFreeEmpty1) {
+  CountingResource resource;
+  s21::pmr::map<int, int> s21_map(&resource);
+  s21::pmr::map<int, int> s21_map_move(std::move(s21_map));
+  s21::pmr::map<int, int> s21_map_swap(&resource);
+  s21_map_move.swap(s21_map_swap);
+  EXPECT_EQ(resource.allocations, 0U);
+  s21_map_swap[1] = 1;
+  size_t allocations = resource.allocations;
+  s21::pmr::map<int, int> s21_map_moved(std::move(s21_map_swap));
+  EXPECT_EQ(resource.allocations, allocations);
+  EXPECT_EQ(s21_map_moved.at(1), 1);
+  EXPECT_TRUE(s21_map_swap.empty());
+  EXPECT_TRUE(s21_map_swap.begin() == s21_map_swap.end());
+}
+TEST(Set, NoDefaultKey1) {
+  s21::set<NoDefaultKey> s21_set;
+  s21_set.insert(NoDefaultKey(2));
+  s21_set.insert(NoDefaultKey(1));
+  EXPECT_EQ(s21_set.size(), 2U);
+  EXPECT_EQ((*s21_set.begin()).value, 1);
+  EXPECT_TRUE(s21_set.contains(NoDefaultKey(2)));
+}
+TEST(SplitMap, Basic1) {
+  struct Payload {
+    int id;
+    char blob[200];
+  };
+  s21::split_map<int, Payload> s21_map;
+  std::map<int, int> std_map;
+  for (int i = 0; i < 100; ++i) {
+    int key = (i * 37) % 101;
+    Payload p{};
+    p.id = i;
+    EXPECT_EQ(s21_map.insert(key, p).second,
+              std_map.insert({key, i}).second);
+  }
+  EXPECT_FALSE(s21_map.insert(37, Payload{}).second);
+  EXPECT_EQ(s21_map.size(), std_map.size());
+  auto s21_i = s21_map.begin();
+  for (auto std_i = std_map.begin(); std_i != std_map.end(); ++std_i) {
+    EXPECT_EQ((*s21_i).first, std_i->first);
+    EXPECT_EQ((*s21_i).second.id, std_i->second);
+    ++s21_i;
+  }
+  EXPECT_EQ(s21_map.at(37).id, 1);
+  EXPECT_THROW(s21_map.at(1000), std::out_of_range);
+  s21_map.erase(s21_map.find(37));
+  EXPECT_FALSE(s21_map.contains(37));
+  s21_map[37].id = 7;
+  EXPECT_EQ(s21_map.at(37).id, 7);
+}
+TEST(SplitMap, CopyMove1) {
+  s21::split_map<std::string, std::string> s21_map(
+      {{"a", "1"}, {"b", "2"}, {"c", "3"}});
+  s21::split_map<std::string, std::string> s21_copy(s21_map);
+  s21_copy.insert_or_assign("a", "x");
+  EXPECT_EQ(s21_map.at("a"), "1");
+  EXPECT_EQ(s21_copy.at("a"), "x");
+  s21::split_map<std::string, std::string> s21_move(std::move(s21_copy));
+  EXPECT_EQ(s21_move.size(), 3U);
+  EXPECT_TRUE(s21_copy.empty());
+  s21_copy = s21_move;
+  s21_move = std::move(s21_map);
+  EXPECT_EQ(s21_copy.at("a"), "x");
+  EXPECT_EQ(s21_move.at("a"), "1");
+  s21_copy.swap(s21_move);
+  EXPECT_EQ(s21_copy.at("c"), "3");
+  EXPECT_EQ(s21_move.at("a"), "x");
+}
+TEST(Map, MemoryUsage1) {
+  s21::map<int, int> s21_map;
+  EXPECT_EQ(s21_map.memory_usage().node_bytes, 0U);
+  EXPECT_EQ(s21_map.memory_usage().slab_overhead, 0U);
+  for (int i = 0; i < 100; ++i) {
+    s21_map[i] = i;
+  }
+  s21::MemoryUsage usage = s21_map.memory_usage();
+  EXPECT_GE(usage.node_bytes, 100 * sizeof(s21::map<int, int>::node_type));
+  EXPECT_GT(usage.sentinel_bytes, 0U);
+  EXPECT_EQ(usage.payload_bytes, 0U);
+  EXPECT_EQ(usage.total(), usage.node_bytes + usage.sentinel_bytes +
+                               usage.slab_overhead + usage.payload_bytes);
+}
+TEST(Map, MemoryBudget1) {
+  s21::map<int, int> s21_map;
+  s21_map.set_memory_budget(64 * sizeof(s21::map<int, int>::node_type));
+  int inserted = 0;
+  EXPECT_THROW(
+      for (; inserted < 1000; ++inserted) { s21_map.insert(inserted, 0); },
+      std::length_error);
+  EXPECT_EQ(s21_map.size(), size_t(inserted));
+  EXPECT_EQ(inserted, 64);
+  s21_map.erase(s21_map.begin());
+  EXPECT_TRUE(s21_map.insert(5000, 0).second);
+
+  size_t requested = 0;
+  s21_map.set_memory_budget(0, [&requested](size_t bytes) {
+    requested = bytes;
+    return true;
+  });
+  EXPECT_TRUE(s21_map.insert(6000, 0).second);
+  EXPECT_GT(requested, 0U);
+  s21_map.clear_memory_budget();
+}
+TEST(SplitMap, MemoryUsage1) {
+  struct Payload {
+    char blob[200];
+  };
+  s21::split_map<int, Payload> s21_map;
+  for (int i = 0; i < 10; ++i) {
+    s21_map.insert(i, Payload{});
+  }
+  s21::MemoryUsage usage = s21_map.memory_usage();
+  EXPECT_EQ(usage.payload_bytes, 10 * sizeof(Payload));
+  s21_map.set_memory_budget(usage.total());
+  EXPECT_THROW(
+      for (int i = 10; i < 1000; ++i) { s21_map.insert(i, Payload{}); },
+      std::length_error);
+  EXPECT_EQ(s21_map.size(), s21_map.memory_usage().payload_bytes / 200);
+}
+TEST(Map, Compact1) {
+  s21::map<int, int> s21_map;
+  std::map<int, int> std_map;
+  for (int i = 0; i < 1000; ++i) {
+    int key = (i * 7919) % 1000;
+    s21_map.insert(key, i);
+    std_map.insert({key, i});
+  }
+  for (auto i = s21_map.begin(); i != s21_map.end();) {
+    std_map.erase((*i).first);
+    s21_map.erase(i++);
+    if (i != s21_map.end())
+      ++i;
+  }
+  s21_map.compact();
+  EXPECT_EQ(s21_map.capacity(), s21_map.size());
+  auto i = s21_map.begin();
+  const auto *prev = &*i;
+  for (auto j = std_map.begin(); j != std_map.end(); ++i, ++j) {
+    EXPECT_EQ(*i, *j);
+    EXPECT_TRUE(&*i == prev || &*i > prev);
+    prev = &*i;
+  }
+  s21_map.compact(s21::CompactOrder::BREADTH_FIRST);
+  EXPECT_TRUE(std::equal(std_map.begin(), std_map.end(), s21_map.begin()));
+  EXPECT_FALSE(s21_map.contains(0));
+  EXPECT_TRUE(s21_map.contains(1));
+}
+TEST(Set, AutoCompact1) {
+  s21::set<int> s21_set;
+  s21_set.set_auto_compact(100);
+  for (int i = 0; i < 500; ++i) {
+    s21_set.insert(i);
+  }
+  size_t peak = s21_set.capacity();
+  for (int i = 0; i < 400; ++i) {
+    s21_set.erase(s21_set.begin());
+  }
+  EXPECT_LT(s21_set.capacity(), peak);
+  EXPECT_EQ(s21_set.size(), 100U);
+  EXPECT_EQ(*s21_set.begin(), 400);
+}
+
+TEST(Map, Detach1) {
+  s21::map<int, std::string> s21_map;
+  for (int i = 0; i < 1000; ++i) {
+    s21_map.insert(i, std::string(40, 'x'));
+  }
+  auto garbage = s21_map.detach();
+  EXPECT_TRUE(s21_map.empty());
+  EXPECT_EQ(s21_map.capacity(), 0U);
+  EXPECT_TRUE(s21_map.insert(7, "seven").second);
+  EXPECT_EQ(garbage.size(), 1000U);
+  int rounds = 0;
+  while (garbage.reclaim(64)) {
+    ++rounds;
+  }
+  EXPECT_EQ(garbage.size(), 0U);
+  EXPECT_GE(rounds, 1000 / 64);
+  EXPECT_EQ(s21_map.at(7), "seven");
+}
+TEST(Set, ClearDeferred1) {
+  s21::Reclaimer reclaimer;
+  s21::set<std::string> s21_set;
+  for (int i = 0; i < 1000; ++i) {
+    s21_set.insert(std::to_string(i));
+  }
+  s21_set.clear_deferred(reclaimer);
+  EXPECT_EQ(s21_set.size(), 0U);
+  EXPECT_EQ(s21_set.begin(), s21_set.end());
+  s21_set.insert("again");
+  reclaimer.drain();
+  EXPECT_EQ(*s21_set.begin(), "again");
+}
+
+TEST(SmallMap, Inline1) {
+  CountingResource resource;
+  s21::pmr::small_map<int, std::string, 8> s21_map(&resource);
+  for (int i = 7; i >= 0; --i) {
+    s21_map.insert(i, std::to_string(i));
+  }
+  EXPECT_TRUE(s21_map.is_inline());
+  EXPECT_EQ(resource.allocations, 0U);
+  EXPECT_FALSE(s21_map.insert(3, "dup").second);
+  EXPECT_EQ(s21_map.at(3), "3");
+  auto copy = s21_map;
+  s21_map.erase(s21_map.begin());
+  EXPECT_EQ(copy.at(0), "0");
+  s21_map = std::move(copy);
+  s21_map[8] = "8";
+  EXPECT_FALSE(s21_map.is_inline());
+  EXPECT_GT(resource.allocations, 0U);
+  int expected = 0;
+  for (auto i = s21_map.begin(); i != s21_map.end(); ++i, ++expected) {
+    EXPECT_EQ((*i).first, expected);
+    EXPECT_EQ((*i).second, std::to_string(expected));
+  }
+  EXPECT_EQ(expected, 9);
+  s21_map.clear();
+  EXPECT_TRUE(s21_map.is_inline());
+  EXPECT_THROW(s21_map.at(3), std::out_of_range);
+}
+TEST(SmallMap, Merge1) {
+  s21::small_map<int, std::string, 4> target, source;
+  target.insert(1, "one");
+  source.insert(1, "uno");
+  source.insert(2, "dos");
+  target.merge(source);
+  EXPECT_EQ(target.size(), 2U);
+  EXPECT_EQ(target.at(1), "one");
+  EXPECT_EQ(target.at(2), "dos");
+  ASSERT_EQ(source.size(), 1U);
+  EXPECT_EQ(source.at(1), "uno");
+  for (int i = 0; i < 100; ++i) {
+    source.insert(i, std::to_string(-i));
+    if (i % 10 == 0)
+      target.insert(i, std::to_string(i));
+  }
+  target.merge(source);
+  EXPECT_EQ(target.size(), 100U);
+  EXPECT_EQ(source.size(), 12U);
+  for (auto i = source.begin(); i != source.end(); ++i)
+    EXPECT_TRUE((*i).first % 10 == 0 || (*i).first < 3);
+  EXPECT_EQ(target.at(10), "10");
+  EXPECT_EQ(target.at(99), "-99");
+}
+TEST(SmallSet, Merge1) {
+  s21::small_set<int, 4> target({1}), source({1, 2});
+  target.merge(source);
+  EXPECT_EQ(target.size(), 2U);
+  ASSERT_EQ(source.size(), 1U);
+  EXPECT_TRUE(source.contains(1));
+  for (int i = 0; i < 100; ++i)
+    source.insert(i);
+  target.merge(source);
+  EXPECT_EQ(target.size(), 100U);
+  EXPECT_EQ(source.size(), 2U);
+  EXPECT_TRUE(source.contains(2));
+}
+TEST(SmallSet, Random1) {
+  s21::small_set<std::string, 4> s21_set;
+  std::set<std::string> std_set;
+  unsigned state = 1;
+  for (int op = 0; op < 3000; ++op) {
+    state = state * 1103515245 + 12345;
+    std::string key = std::to_string((state >> 16) % 12);
+    if (op % 500 == 499) {
+      s21_set.clear();
+      std_set.clear();
+    } else if ((state >> 8) % 3 == 0) {
+      auto i = s21_set.find(key);
+      EXPECT_EQ(i != s21_set.end(), std_set.count(key) == 1);
+      if (i != s21_set.end())
+        s21_set.erase(i);
+      std_set.erase(key);
+    } else {
+      EXPECT_EQ(s21_set.insert(key).second, std_set.insert(key).second);
+    }
+    ASSERT_EQ(s21_set.size(), std_set.size());
+    EXPECT_TRUE(std::equal(std_set.begin(), std_set.end(), s21_set.begin()));
+  }
+  s21::small_set<std::string, 4> copy(s21_set);
+  s21::small_set<std::string, 4> moved(std::move(s21_set));
+  EXPECT_TRUE(std::equal(std_set.begin(), std_set.end(), copy.begin()));
+  EXPECT_TRUE(std::equal(std_set.begin(), std_set.end(), moved.begin()));
+  copy.swap(moved);
+  EXPECT_EQ(copy.size(), std_set.size());
+}
+
+TEST(Map, Emplace1) {
+  s21::map<std::string, CopyCounter> s21_map;
+  CopyCounter::copies = CopyCounter::constructions = 0;
+  EXPECT_TRUE(s21_map.emplace("a", 1).second);
+  EXPECT_TRUE(s21_map.try_emplace("b", 2).second);
+  EXPECT_TRUE(
+      s21_map.insert(std::make_pair(std::string("c"), CopyCounter(3))).second);
+  EXPECT_EQ(CopyCounter::copies, 0);
+  int before = CopyCounter::constructions;
+  EXPECT_FALSE(s21_map.try_emplace("b", 7).second);
+  EXPECT_EQ(CopyCounter::constructions, before);
+  EXPECT_FALSE(s21_map.emplace("a", 9).second);
+  EXPECT_EQ(s21_map.at("a").value, 1);
+  auto i = s21_map.emplace_hint(s21_map.end(), "d", 4);
+  EXPECT_EQ((*i).second.value, 4);
+  EXPECT_EQ(s21_map.size(), 4U);
+  EXPECT_EQ(CopyCounter::copies, 0);
+}
+TEST(Set, Emplace1) {
+  s21::set<CopyCounter> s21_set;
+  CopyCounter::copies = 0;
+  EXPECT_TRUE(s21_set.emplace(2).second);
+  EXPECT_TRUE(s21_set.insert(CopyCounter(1)).second);
+  EXPECT_FALSE(s21_set.emplace(2).second);
+  EXPECT_EQ(CopyCounter::copies, 0);
+  EXPECT_EQ((*s21_set.begin()).value, 1);
+}
+
+// each upsert descends the tree once: about log2(n) comparisons, where the
+// old find-then-insert paths needed two or three descents
+TEST(Map, SingleDescent1) {
+  const int n = 4096;
+  s21::map<int, int, CountingLess> s21_map;
+  for (int i = 0; i < n; ++i) {
+    s21_map.insert(i * 2, i);
+  }
+  CountingLess::calls = 0;
+  for (int i = 0; i < n; ++i) {
+    s21_map[i * 2] += 1;
+    s21_map.insert_or_assign(i * 2, i);
+    s21_map.insert(i * 2, 0);
+  }
+  double per_hit = double(CountingLess::calls) / (3 * n);
+  CountingLess::calls = 0;
+  for (int i = 0; i < n; ++i) {
+    s21_map[i * 2 + 1] = i;
+  }
+  double per_miss = double(CountingLess::calls) / n;
+  EXPECT_LT(per_hit, 16.0);
+  EXPECT_LT(per_miss, 16.0);
+}
+TEST(SmallMap, SingleDescent1) {
+  const int n = 32;
+  s21::small_map<int, int, n, CountingLess> s21_map;
+  for (int i = 0; i < n; ++i) {
+    s21_map.insert(i * 2, i);
+  }
+  CountingLess::calls = 0;
+  for (int i = 0; i < n; ++i) {
+    s21_map[i * 2] += 1;
+    s21_map.insert_or_assign(i * 2, i);
+  }
+  // bisecting 32 slots takes at most 6 comparisons, plus one for equality
+  EXPECT_LE(CountingLess::calls, 7U * 2 * n);
+  EXPECT_TRUE(s21_map.is_inline());
+  EXPECT_EQ(s21_map[6], 3);
+}
+
+TEST(Map, HintedInsert1) {
+  const int n = 2000;
+  s21::map<int, int, CountingLess> s21_map;
+  CountingLess::calls = 0;
+  for (int i = 0; i < n; ++i) {
+    s21_map.insert(s21_map.end(), std::make_pair(i * 2, i));
+  }
+  EXPECT_LE(CountingLess::calls, size_t(2 * n));
+  CountingLess::calls = 0;
+  auto hint = s21_map.begin();
+  for (int i = 0; i < n; ++i, ++hint) {
+    s21_map.emplace_hint(hint, i * 2 - 1, -i);
+  }
+  EXPECT_LE(CountingLess::calls, size_t(3 * n));
+  EXPECT_EQ(s21_map.size(), size_t(2 * n));
+  int expected = -1;
+  for (auto i = s21_map.begin(); i != s21_map.end(); ++i, ++expected) {
+    EXPECT_EQ((*i).first, expected);
+  }
+  auto dup = s21_map.insert(s21_map.begin(), std::make_pair(10, 0));
+  EXPECT_EQ((*dup).second, 5);
+}
+TEST(Set, AppendFastPath1) {
+  const int n = 5000;
+  s21::set<int, CountingLess> s21_set;
+  CountingLess::calls = 0;
+  for (int i = 0; i < n; ++i) {
+    s21_set.insert(i);
+  }
+  for (int i = -1; i >= -n; --i) {
+    s21_set.insert(i);
+  }
+  EXPECT_LE(CountingLess::calls, size_t(4 * n));
+  EXPECT_EQ(s21_set.size(), size_t(2 * n));
+  EXPECT_EQ(*s21_set.begin(), -n);
+}
+
+TEST(Map, AssignSorted1) {
+  std::vector<std::pair<int, int>> items;
+  for (int i = 0; i < 1000; ++i) {
+    items.emplace_back(i, i * i);
+  }
+  CountingResource resource;
+  s21::pmr::map<int, int> s21_map(&resource);
+  s21_map.insert(5000, 1);
+  size_t before = resource.allocations;
+  s21_map.assign_sorted(items.begin(), items.end());
+  EXPECT_LE(resource.allocations - before, 2U);
+  EXPECT_EQ(s21_map.size(), 1000U);
+  EXPECT_EQ(s21_map.capacity(), 1000U);
+  EXPECT_FALSE(s21_map.contains(5000));
+  for (int i = 0; i < 1000; i += 7) {
+    EXPECT_EQ(s21_map.at(i), i * i);
+  }
+  for (int i = 1000; i < 1100; ++i) {
+    s21_map.insert(-i, i);
+  }
+  for (int i = 0; i < 500; ++i) {
+    s21_map.erase(s21_map.begin());
+  }
+  EXPECT_EQ((*s21_map.begin()).first, 400);
+
+  std::swap(items[10], items[20]);
+  EXPECT_THROW(s21_map.assign_sorted(items.begin(), items.end()),
+               std::invalid_argument);
+  EXPECT_EQ(s21_map.size(), 600U);
+}
+TEST(Set, RangeConstructor1) {
+  std::vector<int> sorted = {1, 2, 2, 3, 5, 8, 8, 13};
+  s21::set<int> from_sorted(sorted.begin(), sorted.end());
+  EXPECT_EQ(from_sorted.size(), 6U);
+  std::vector<int> shuffled = {8, 1, 13, 2, 5, 3, 2};
+  s21::set<int> from_shuffled(shuffled.begin(), shuffled.end());
+  EXPECT_TRUE(std::equal(from_sorted.begin(), from_sorted.end(),
+                         from_shuffled.begin()));
+  s21::set<int> unchecked;
+  unchecked.assign_sorted(from_sorted.begin(), from_sorted.end(), false);
+  EXPECT_EQ(unchecked.size(), 6U);
+  EXPECT_EQ(*unchecked.begin(), 1);
+}
+
+TEST(Map, CopyClone1) {
+  s21::map<int, int> source;
+  for (int i = 0; i < 3000; ++i) {
+    source.insert((i * 7919) % 3000, i);
+  }
+  for (int i = 0; i < 3000; i += 3) {
+    source.erase(source.begin());
+  }
+  CountingResource resource;
+  s21::pmr::map<int, int> copy(&resource);
+  for (auto i = source.begin(); i != source.end(); ++i) {
+    copy.insert(*i);
+  }
+  size_t before = resource.allocations;
+  s21::pmr::map<int, int> clone(copy, &resource);
+  EXPECT_LE(resource.allocations - before, 2U);
+  EXPECT_EQ(clone.capacity(), clone.size());
+  EXPECT_TRUE(std::equal(source.begin(), source.end(), clone.begin()));
+  clone.insert(-1, 0);
+  clone.erase(clone.begin());
+  EXPECT_TRUE(std::equal(source.begin(), source.end(), clone.begin()));
+}
+TEST(Map, CopyAssignStrong1) {
+  s21::map<int, ThrowingCopy> source, target;
+  for (int i = 0; i < 100; ++i) {
+    source.emplace(i, ThrowingCopy(i));
+  }
+  target.emplace(7, ThrowingCopy(70));
+  ThrowingCopy::copies_left = 50;
+  EXPECT_THROW(target = source, std::runtime_error);
+  ThrowingCopy::copies_left = -1;
+  EXPECT_EQ(target.size(), 1U);
+  EXPECT_EQ(target.at(7).value, 70);
+  target = source;
+  EXPECT_EQ(target.size(), 100U);
+  EXPECT_EQ(target.at(7).value, 7);
+}
+TEST(SplitMap, CopyAssignStrong1) {
+  s21::split_map<int, ThrowingCopy> source, target;
+  for (int i = 0; i < 100; ++i) {
+    source.insert(i, ThrowingCopy(i));
+  }
+  target.insert(7, ThrowingCopy(70));
+  ThrowingCopy::copies_left = 50;
+  EXPECT_THROW(target = source, std::runtime_error);
+  ThrowingCopy::copies_left = -1;
+  EXPECT_EQ(target.size(), 1U);
+  EXPECT_EQ(target.at(7).value, 70);
+  target = source;
+  EXPECT_EQ(target.size(), 100U);
+  EXPECT_EQ(target.at(7).value, 7);
+}
+
+TEST(Map, MergeSplice1) {
+  CountingResource resource;
+  s21::pmr::map<int, int> target(&resource), source(&resource);
+  for (int i = 0; i < 1000; ++i) {
+    source.insert(i, i);
+    if (i % 10 == 0)
+      target.insert(i, -i);
+  }
+  size_t before = resource.allocations;
+  target.merge(source);
+  EXPECT_LE(resource.allocations - before, 2U);
+  EXPECT_EQ(target.size(), 1000U);
+  EXPECT_EQ(source.size(), 100U);
+  for (const auto &i : source)
+    EXPECT_EQ(i.first % 10, 0);
+  EXPECT_EQ(target.at(10), -10);
+  source.clear();
+  source.insert(5000, 5000);
+  EXPECT_EQ(target.at(999), 999);
+}
+
+TEST(Map, ExtractInsert1) {
+  s21::map<int, std::string> first({{1, "one"}, {2, "two"}, {3, "three"}});
+  s21::map<int, std::string> second({{3, "drei"}});
+  auto node = first.extract(2);
+  ASSERT_FALSE(node.empty());
+  EXPECT_EQ(first.size(), 2U);
+  EXPECT_TRUE(first.extract(42).empty());
+  node.key() = 4;
+  auto res = second.insert(std::move(node));
+  EXPECT_TRUE(res.inserted);
+  EXPECT_TRUE(res.node.empty());
+  EXPECT_EQ((*res.position).second, "two");
+  auto dup = first.extract(first.begin());
+  dup.key() = 3;
+  res = second.insert(std::move(dup));
+  EXPECT_FALSE(res.inserted);
+  EXPECT_EQ(res.node.mapped(), "one");
+  EXPECT_EQ((*res.position).second, "drei");
+  EXPECT_EQ(second.size(), 2U);
+}
+
+TEST(Map, ExtractDropChurn1) {
+  s21::map<int, int> s21_map;
+  for (int i = 0; i < 1000; ++i)
+    s21_map[i] = i;
+  size_t capacity = s21_map.capacity();
+  for (int i = 1000; i < 100000; ++i) {
+    s21_map.extract(s21_map.begin());
+    s21_map[i] = i;
+  }
+  EXPECT_EQ(s21_map.size(), 1000U);
+  EXPECT_EQ(s21_map.capacity(), capacity);
+  EXPECT_EQ((*s21_map.begin()).first, 99000);
+}
+
+TEST(Set, NodeOutlivesSource1) {
+  s21::set<std::string>::node_handle node;
+  s21::set<std::string> target;
+  {
+    s21::set<std::string> source({"alpha", "beta", "gamma"});
+    node = source.extract(source.begin());
+    target.merge(source);
+  }
+  EXPECT_EQ(node.value(), "alpha");
+  EXPECT_TRUE(target.insert(std::move(node)).inserted);
+  EXPECT_EQ(target.size(), 3U);
+  target.erase(target.begin());
+  target.insert("delta");
+  EXPECT_EQ(*target.begin(), "beta");
+}
+
+TEST(Map, ApplyBatch1) {
+  s21::map<int, std::string> s21_map;
+  std::map<int, std::string> std_map;
+  for (int i = 0; i < 1000; i += 2) {
+    s21_map.insert(i, "old");
+    std_map.emplace(i, "old");
+  }
+  using entry = s21::map<int, std::string>::batch_entry;
+  std::vector<entry> batch;
+  for (int i = 999; i >= 0; i -= 3) {
+    batch.push_back(entry(i, std::to_string(i)));
+    if (i % 5 == 0)
+      batch.push_back(entry(i, std::nullopt));
+  }
+  batch.push_back(entry(2, std::nullopt));
+  batch.push_back(entry(2, std::string("again")));
+  std::vector<bool> expected;
+  for (const auto &e : batch) {
+    if (e.second) {
+      expected.push_back(std_map.count(e.first) == 0);
+      std_map[e.first] = *e.second;
+    } else {
+      expected.push_back(std_map.erase(e.first) == 1);
+    }
+  }
+  EXPECT_EQ(s21_map.apply_batch(std::move(batch)), expected);
+  ASSERT_EQ(s21_map.size(), std_map.size());
+  auto s21_i = s21_map.begin();
+  for (const auto &i : std_map)
+    EXPECT_EQ(*s21_i++, i);
+}
+TEST(Map, ApplyBatchConst1) {
+  using entry = s21::map<int, std::string>::batch_entry;
+  const std::vector<entry> batch = {{1, std::string("one")}, {2, std::nullopt}};
+  s21::map<int, std::string> s21_map({{2, "two"}});
+  EXPECT_EQ(s21_map.apply_batch(std::move(batch)),
+            std::vector<bool>({true, true}));
+  EXPECT_EQ(*batch[0].second, "one");
+  EXPECT_EQ(s21_map.at(1), "one");
+  EXPECT_FALSE(s21_map.contains(2));
+}
+
+TEST(Set, ApplyBatch1) {
+  s21::set<int> s21_set({1, 3, 5, 7});
+  std::vector<s21::set<int>::batch_entry> batch = {
+      {9, true}, {3, false}, {4, true}, {3, true}, {8, false}, {1, true}};
+  std::vector<bool> expected = {true, true, true, true, false, false};
+  EXPECT_EQ(s21_set.apply_batch(batch), expected);
+  std::vector<int> content(s21_set.begin(), s21_set.end());
+  EXPECT_EQ(content, std::vector<int>({1, 3, 4, 5, 7, 9}));
+  auto res = s21_set.insert_many(6, 2, 6, 0);
+  EXPECT_TRUE(res[0].second && res[1].second && res[3].second);
+  EXPECT_FALSE(res[2].second);
+  EXPECT_EQ(res[2].first, res[0].first);
+  EXPECT_EQ(*res[3].first, 0);
+  EXPECT_EQ(s21_set.size(), 9U);
+}
+
+TEST(Map, EraseRange1) {
+  s21::map<int, int> s21_map;
+  std::map<int, int> std_map;
+  for (int i = 0; i < 5000; ++i) {
+    s21_map.insert(i * 3, i);
+    std_map.emplace(i * 3, i);
+  }
+  s21_map.erase_before(4500);
+  std_map.erase(std_map.begin(), std_map.lower_bound(4500));
+  s21_map.erase_after(13000);
+  std_map.erase(std_map.upper_bound(13000), std_map.end());
+  auto first = s21_map.begin(), last = s21_map.begin();
+  for (int i = 0; i < 100; ++i)
+    ++first;
+  for (int i = 0; i < 2000; ++i)
+    ++last;
+  s21_map.erase(first, last);
+  auto std_first = std::next(std_map.begin(), 100);
+  std_map.erase(std_first, std::next(std_first, 1900));
+  s21_map.erase(s21_map.begin(), s21_map.begin());
+  ASSERT_EQ(s21_map.size(), std_map.size());
+  auto s21_i = s21_map.begin();
+  for (const auto &i : std_map)
+    EXPECT_EQ(*s21_i++, i);
+  s21_map.erase(s21_map.begin(), s21_map.end());
+  EXPECT_TRUE(s21_map.empty());
+  s21_map.insert(1, 1);
+  EXPECT_EQ(s21_map.size(), 1U);
+}
+
+TEST(Map, SplitJoin1) {
+  s21::map<int, int> low;
+  for (int i = 0; i < 1000; ++i)
+    low.insert(i, -i);
+  s21::map<int, int> high = low.split(300);
+  EXPECT_EQ(low.size(), 300U);
+  EXPECT_EQ(high.size(), 700U);
+  EXPECT_EQ((*low.begin()).first, 0);
+  EXPECT_EQ((*high.begin()).first, 300);
+  EXPECT_EQ(high.at(999), -999);
+  s21::map<int, int> mid = high.split(600);
+  s21::map<int, int> inside({{250, 0}});
+  EXPECT_THROW(low.join(inside), std::invalid_argument);
+  EXPECT_EQ(inside.size(), 1U);
+  low.join(high);
+  EXPECT_TRUE(high.empty());
+  high.join(mid);
+  low.join(high);
+  ASSERT_EQ(low.size(), 1000U);
+  int expected = 0;
+  for (const auto &i : low)
+    EXPECT_EQ(i.first, expected++);
+  s21::map<int, int> empty = low.split(5000);
+  EXPECT_TRUE(empty.empty());
+  empty.join(low);
+  EXPECT_EQ(empty.size(), 1000U);
+}
+
+TEST(Set, SplitInto1) {
+  using tree =
+      s21::RBTree<std::string, std::string, s21::Identity<std::string>,
+                  std::less<std::string>>;
+  std::vector<std::string> words = {"ant", "bee", "cat", "dog", "eel"};
+  tree left, right;
+  left.assign_sorted(words.begin(), words.end());
+  std::vector<std::string> stale = {std::string(40, 'x'), "yak", "zebu"};
+  right.assign_sorted(stale.begin(), stale.end());
+  left.split("cow", right);
+  EXPECT_EQ(left.size(), 3U);
+  ASSERT_EQ(right.size(), 2U);
+  EXPECT_EQ(*right.begin(), "dog");
+  EXPECT_TRUE(left.verify());
+  EXPECT_TRUE(right.verify());
+}
+
+TEST(Set, SplitErase1) {
+  s21::set<std::string> words({"ant", "bee", "cat", "dog", "eel", "fox"});
+  s21::set<std::string> tail = words.split("cow");
+  EXPECT_EQ(words.size(), 3U);
+  EXPECT_EQ(*tail.begin(), "dog");
+  tail.erase_after("eel");
+  words.erase_before("bee");
+  words.join(tail);
+  std::vector<std::string> content(words.begin(), words.end());
+  EXPECT_EQ(content, std::vector<std::string>({"bee", "cat", "dog", "eel"}));
+}
+
+TEST(Set, Algebra1) {
+  std::vector<int> a, b;
+  for (int i = 0; i < 60000; ++i) {
+    a.push_back(i * 3);
+    if (i % 7 != 0)
+      b.push_back(i * 2);
+  }
+  auto build = [](const std::vector<int> &v) {
+    s21::set<int> res;
+    res.assign_sorted(v.begin(), v.end());
+    return res;
+  };
+  using algorithm = std::vector<int>::iterator (*)(
+      std::vector<int>::const_iterator, std::vector<int>::const_iterator,
+      std::vector<int>::const_iterator, std::vector<int>::const_iterator,
+      std::vector<int>::iterator);
+  auto expect = [&](algorithm f) {
+    std::vector<int> out(a.size() + b.size());
+    out.resize(f(a.begin(), a.end(), b.begin(), b.end(), out.begin()) -
+               out.begin());
+    return out;
+  };
+  auto as_vector = [](const s21::set<int> &s) {
+    return std::vector<int>(s.begin(), s.end());
+  };
+  s21::set<int> u = s21::set_union(build(a), build(b));
+  EXPECT_EQ(as_vector(u), expect(std::set_union));
+  EXPECT_EQ(u.size(), expect(std::set_union).size());
+  s21::set<int> i = s21::set_intersection(build(a), build(b));
+  EXPECT_EQ(as_vector(i), expect(std::set_intersection));
+  s21::set<int> d = s21::set_difference(build(a), build(b));
+  EXPECT_EQ(as_vector(d), expect(std::set_difference));
+  s21::set<int> e = build(a);
+  e.subtract(e);
+  EXPECT_TRUE(e.empty());
+}
+
+TEST(Set, AlgebraForked1) {
+  using tree = s21::RBTree<int, int, s21::Identity<int>, std::less<int>>;
+  // fork on every large enough step whatever the machine
+  tree::set_parallel_depth(4);
+  std::vector<int> a, b;
+  for (int i = 0; i < 60000; ++i) {
+    a.push_back(i * 3);
+    if (i % 7 != 0)
+      b.push_back(i * 2);
+  }
+  using algorithm = std::vector<int>::iterator (*)(
+      std::vector<int>::const_iterator, std::vector<int>::const_iterator,
+      std::vector<int>::const_iterator, std::vector<int>::const_iterator,
+      std::vector<int>::iterator);
+  auto check = [&](int op, algorithm f) {
+    tree x, y;
+    x.assign_sorted(a.begin(), a.end());
+    y.assign_sorted(b.begin(), b.end());
+    auto keep = [](int &, int &) {};
+    if (op == 0)
+      x.unite(y, keep);
+    else if (op == 1)
+      x.intersect(y, keep);
+    else
+      x.subtract(y);
+    std::vector<int> expected(a.size() + b.size());
+    expected.resize(f(a.begin(), a.end(), b.begin(), b.end(),
+                      expected.begin()) -
+                    expected.begin());
+    EXPECT_TRUE(x.verify());
+    EXPECT_TRUE(y.verify());
+    EXPECT_EQ(y.size(), 0U);
+    EXPECT_EQ(std::vector<int>(x.begin(), x.end()), expected);
+    EXPECT_EQ(x.size(), expected.size());
+  };
+  check(0, std::set_union);
+  check(1, std::set_intersection);
+  check(2, std::set_difference);
+  tree::set_parallel_depth(-1);
+}
+
+TEST(Map, UnionCombine1) {
+  CountingResource first_resource, second_resource;
+  s21::pmr::map<int, int> a(&first_resource), b(&second_resource);
+  for (int i = 0; i < 3000; ++i) {
+    a.insert(i, 1);
+    b.insert(i + 1500, 10);
+  }
+  s21::pmr::map<int, int> c(a);
+  a.unite(b, std::plus<int>());
+  EXPECT_TRUE(b.empty());
+  EXPECT_EQ(a.size(), 4500U);
+  EXPECT_EQ(a.at(0), 1);
+  EXPECT_EQ(a.at(2000), 11);
+  EXPECT_EQ(a.at(4000), 10);
+  s21::pmr::map<int, int> d(a);
+  d.intersect(c, [](int x, int y) { return x * 100 + y; });
+  EXPECT_EQ(d.size(), 3000U);
+  EXPECT_EQ(d.at(2999), 1101);
+  s21::map<std::string, int> words({{"a", 1}, {"b", 2}});
+  s21::map<std::string, int> more({{"b", 3}, {"c", 4}});
+  auto merged = s21::set_union(words, more);
+  EXPECT_EQ(merged.at("b"), 2);
+  EXPECT_EQ(words.size(), 2U);
+  auto only = s21::set_difference(std::move(words), std::move(more));
+  EXPECT_EQ(only.size(), 1U);
+}
+
+TEST(Map, MergeAll1) {
+  std::vector<s21::map<int, int>> parts(40);
+  std::map<int, int> expected;
+  for (int p = 0; p < 40; ++p) {
+    for (int i = p; i < 3000; i += 7 + p) {
+      parts[p].insert(i, 1);
+      expected[i] += 1;
+    }
+  }
+  auto merged = s21::merge_all(parts, std::plus<int>());
+  for (const auto &part : parts)
+    EXPECT_TRUE(part.empty());
+  ASSERT_EQ(merged.size(), expected.size());
+  auto i = merged.begin();
+  for (const auto &e : expected)
+    EXPECT_EQ(*i++, e);
+  std::vector<s21::map<int, int>> none;
+  EXPECT_TRUE(s21::merge_all(none).empty());
+}
+
+TEST(Map, MergeAllKeepsFirst1) {
+  CountingResource other;
+  s21::pmr::map<int, std::string> target({{1, "target"}});
+  std::vector<s21::pmr::map<int, std::string>> sources;
+  sources.emplace_back(&other);
+  sources.emplace_back();
+  sources[0].insert(1, "first");
+  sources[0].insert(2, "first");
+  sources[1].insert(2, "second");
+  sources[1].insert(3, "second");
+  target.merge_all(sources);
+  EXPECT_EQ(target.size(), 3U);
+  EXPECT_EQ(target.at(1), "target");
+  EXPECT_EQ(target.at(2), "first");
+  EXPECT_EQ(target.at(3), "second");
+  EXPECT_TRUE(sources[0].empty() && sources[1].empty());
+}
+TEST(Map, MergeAllRepeated1) {
+  s21::map<int, int> target({{1, 1}, {2, 2}});
+  s21::map<int, int> source({{2, 20}, {3, 3}});
+  std::vector<std::reference_wrapper<s21::map<int, int>>> sources = {
+      source, target, source};
+  int combined = 0;
+  target.merge_all(sources, [&combined](int mine, int theirs) {
+    ++combined;
+    return mine + theirs;
+  });
+  EXPECT_EQ(combined, 1);
+  EXPECT_EQ(target.size(), 3U);
+  EXPECT_EQ(target.at(2), 22);
+  EXPECT_EQ(target.at(3), 3);
+  EXPECT_TRUE(source.empty());
+  source.insert(4, 4);
+  EXPECT_EQ(source.size(), 1U);
+}
+
+TEST(Map, OrderedLookup1) {
+  s21::map<int, int> s21_map;
+  std::map<int, int> std_map;
+  for (int i = 0; i < 500; ++i) {
+    s21_map.insert(i * 4, i);
+    std_map.emplace(i * 4, i);
+  }
+  auto position = [](auto &m, auto it) {
+    return std::distance(m.begin(), it);
+  };
+  for (int key = -3; key < 2010; ++key) {
+    EXPECT_EQ(position(s21_map, s21_map.lower_bound(key)),
+              position(std_map, std_map.lower_bound(key)));
+    EXPECT_EQ(position(s21_map, s21_map.upper_bound(key)),
+              position(std_map, std_map.upper_bound(key)));
+    auto range = s21_map.equal_range(key);
+    EXPECT_EQ(std::distance(range.first, range.second),
+              std::distance(std_map.equal_range(key).first,
+                            std_map.equal_range(key).second));
+    EXPECT_EQ(s21_map.count(key), std_map.count(key));
+    EXPECT_EQ(s21_map.find(key) != s21_map.end(), std_map.count(key) == 1);
+  }
+}
+
+TEST(Set, OneComparisonPerLevel1) {
+  const int n = 4095;
+  s21::set<int, CountingLess> s21_set;
+  for (int i = 0; i < n; ++i)
+    s21_set.insert(i * 2);
+  CountingLess::calls = 0;
+  for (int i = 0; i < 2 * n; ++i) {
+    s21_set.find(i);
+    s21_set.lower_bound(i);
+  }
+  double per_lookup = double(CountingLess::calls) / (4 * n);
+  EXPECT_LT(per_lookup, 14.0);
+  EXPECT_EQ(*s21_set.upper_bound(100), 102);
+  EXPECT_EQ(s21_set.upper_bound(2 * n), s21_set.end());
+}
+
+TEST(Map, TransparentLookup1) {
+  s21::map<std::string, int, std::less<>> s21_map;
+  for (const char *word : {"alpha", "bravo", "charlie", "delta"})
+    s21_map[word] = int(std::string_view(word).size());
+  std::string_view buffer = "xxcharliexx";
+  std::string_view probe = buffer.substr(2, 7);
+  EXPECT_EQ((*s21_map.find(probe)).first, "charlie");
+  EXPECT_TRUE(s21_map.contains(probe));
+  EXPECT_EQ(s21_map.count(std::string_view("echo")), 0U);
+  EXPECT_EQ(s21_map.at(probe), 7);
+  EXPECT_THROW(s21_map.at(std::string_view("echo")), std::out_of_range);
+  EXPECT_EQ((*s21_map.lower_bound(std::string_view("b"))).first, "bravo");
+  EXPECT_EQ((*s21_map.upper_bound(std::string_view("bravo"))).first,
+            "charlie");
+  auto range = s21_map.equal_range(std::string_view("delta"));
+  EXPECT_EQ(std::distance(range.first, range.second), 1);
+  s21_map[std::string_view("echo")] = 4;
+  EXPECT_EQ(s21_map.at("echo"), 4);
+  EXPECT_EQ(s21_map.erase(probe), 1U);
+  EXPECT_EQ(s21_map.erase(probe), 0U);
+  EXPECT_EQ(s21_map.size(), 4U);
+}
+struct CounterLess {
+  using is_transparent = void;
+  bool operator()(const CopyCounter &a, const CopyCounter &b) const {
+    return a.value < b.value;
+  }
+  bool operator()(const CopyCounter &a, int b) const { return a.value < b; }
+  bool operator()(int a, const CopyCounter &b) const { return a < b.value; }
+};
+TEST(Set, TransparentLookupBuildsNoKey1) {
+  s21::set<CopyCounter, CounterLess> s21_set;
+  for (int i = 0; i < 100; ++i)
+    s21_set.insert(CopyCounter(i * 2));
+  CopyCounter::constructions = 0;
+  EXPECT_EQ((*s21_set.find(42)).value, 42);
+  EXPECT_TRUE(s21_set.find(43) == s21_set.end());
+  EXPECT_EQ(s21_set.count(44), 1U);
+  EXPECT_EQ((*s21_set.lower_bound(45)).value, 46);
+  EXPECT_EQ((*s21_set.upper_bound(46)).value, 48);
+  EXPECT_EQ(s21_set.erase(50), 1U);
+  EXPECT_FALSE(s21_set.contains(50));
+  EXPECT_EQ(CopyCounter::constructions, 0);
+  EXPECT_EQ(s21_set.size(), 99U);
+}
+TEST(SplitMap, TransparentLookup1) {
+  s21::split_map<std::string, int, std::less<>> s21_map;
+  s21_map[std::string_view("left")] = 1;
+  s21_map.insert("right", 2);
+  const auto &view = s21_map;
+  EXPECT_EQ((*view.find(std::string_view("right"))).second, 2);
+  EXPECT_EQ(s21_map.at(std::string_view("left")), 1);
+  EXPECT_EQ(s21_map.erase(std::string_view("left")), 1U);
+  EXPECT_FALSE(s21_map.contains(std::string_view("left")));
+}
+
+TEST(Set, ThreeWayCompare1) {
+  const int n = 4095;
+  s21::set<std::string> s21_set;
+  std::set<std::string> std_set;
+  for (int i = 0; i < n; ++i) {
+    std::string text = "shared/prefix/" + std::to_string(i * 7919 % n * 2);
+    s21_set.insert(text);
+    std_set.insert(text);
+  }
+  for (int i = 0; i < 2 * n; ++i) {
+    std::string probe = "shared/prefix/" + std::to_string(i);
+    auto found = s21_set.find(probe);
+    EXPECT_EQ(found != s21_set.end(), std_set.count(probe) == 1);
+    auto lower = s21_set.lower_bound(probe);
+    auto std_lower = std_set.lower_bound(probe);
+    EXPECT_EQ(lower == s21_set.end(), std_lower == std_set.end());
+    if (lower != s21_set.end() && std_lower != std_set.end()) {
+      EXPECT_EQ(*lower, *std_lower);
+    }
+    auto upper = s21_set.upper_bound(probe);
+    auto std_upper = std_set.upper_bound(probe);
+    if (upper != s21_set.end() && std_upper != std_set.end()) {
+      EXPECT_EQ(*upper, *std_upper);
+    }
+    auto range = s21_set.equal_range(probe);
+    EXPECT_EQ(std::distance(range.first, range.second),
+              std::distance(std_lower, std_upper));
+  }
+  EXPECT_FALSE(s21_set.insert("shared/prefix/0").second);
+  EXPECT_EQ(s21_set.size(), std_set.size());
+}
+
+struct Word {
+  static size_t less_calls;
+  static size_t compare_calls;
+  std::string text;
+  bool operator<(const Word &other) const {
+    ++less_calls;
+    return text < other.text;
+  }
+  int compare(const Word &other) const {
+    ++compare_calls;
+    return text.compare(other.text);
+  }
+};
+size_t Word::less_calls = 0;
+size_t Word::compare_calls = 0;
+TEST(Set, ThreeWayCompare2) {
+  s21::set<Word> s21_set;
+  for (int i = 0; i < 100; ++i) s21_set.insert(Word{std::to_string(i)});
+  Word::less_calls = Word::compare_calls = 0;
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(s21_set.contains(Word{std::to_string(i)}), i < 100);
+  }
+  EXPECT_GT(Word::less_calls, 0U);
+  EXPECT_EQ(Word::compare_calls, 0U);
+}
+
+struct Tag {
+  int id;
+  bool operator<(const Tag &other) const { return id < other.id; }
+  bool compare(const Tag &other) const { return id == other.id; }
+};
+TEST(Set, ThreeWayCompare3) {
+  s21::set<Tag> s21_set;
+  for (int i = 0; i < 10; ++i) EXPECT_TRUE(s21_set.insert(Tag{i}).second);
+  EXPECT_EQ(s21_set.size(), 10U);
+  for (int i = 0; i < 10; ++i) EXPECT_TRUE(s21_set.contains(Tag{i}));
+  EXPECT_FALSE(s21_set.contains(Tag{10}));
+}
+
+TEST(Map, PrefixLess1) {
+  s21::map<std::string, int, s21::PrefixLess<>> s21_map;
+  std::map<std::string, int> std_map;
+  std::string long_key(20, 'k');
+  std::vector<std::string> keys = {"",
+                                   "a",
+                                   std::string("a\0", 2),
+                                   "abcdefgh",
+                                   "abcdefghi",
+                                   "abcdefgh\xff",
+                                   long_key,
+                                   long_key + "a",
+                                   long_key + "b",
+                                   "\x80"};
+  for (size_t i = 0; i < keys.size(); ++i) {
+    s21_map[keys[i]] = int(i);
+    std_map[keys[i]] = int(i);
+  }
+  auto j = std_map.begin();
+  for (auto i = s21_map.begin(); i != s21_map.end(); ++i, ++j)
+    EXPECT_EQ((*i).first, j->first);
+  for (const std::string &key : keys) {
+    std::string_view view = key;
+    EXPECT_EQ((*s21_map.find(view)).second, std_map[key]);
+    std::string past = key + "\x01";
+    auto upper = s21_map.upper_bound(key);
+    auto std_upper = std_map.upper_bound(key);
+    ASSERT_EQ(upper == s21_map.end(), std_upper == std_map.end());
+    if (upper != s21_map.end()) {
+      EXPECT_EQ((*upper).first, std_upper->first);
+    }
+    EXPECT_FALSE(s21_map.contains(std::string_view(past)));
+  }
+  EXPECT_EQ(s21_map.count(long_key + "c"), 0U);
+  auto node = s21_map.extract(long_key);
+  node.key() = "b";
+  EXPECT_TRUE(s21_map.insert(std::move(node)).inserted);
+  EXPECT_EQ((*s21_map.lower_bound(std::string_view("az"))).first, "b");
+  EXPECT_EQ(s21_map.at("b"), 6);
+}
+
+TEST(Map, FindMany1) {
+  s21::map<int, int> s21_map;
+  EXPECT_EQ(s21_map.find_many(std::vector<int>{1, 2})[1], s21_map.end());
+  std::map<int, int> std_map;
+  for (int i = 0; i < 1000; ++i) {
+    int key = (i * 7919) % 3000;
+    s21_map[key] = i;
+    std_map[key] = i;
+  }
+  std::vector<int> probes;
+  for (int i = 0; i < 2000; ++i)
+    probes.push_back((i * 104729) % 3100 - 50);
+  probes.push_back(probes.front());
+  auto found = s21_map.find_many(probes);
+  auto contained = s21_map.contains_many(probes);
+  ASSERT_EQ(found.size(), probes.size());
+  for (size_t i = 0; i < probes.size(); ++i) {
+    auto std_found = std_map.find(probes[i]);
+    ASSERT_EQ(found[i] == s21_map.end(), std_found == std_map.end());
+    EXPECT_EQ(contained[i], std_found != std_map.end());
+    if (std_found != std_map.end()) {
+      EXPECT_EQ((*found[i]).second, std_found->second);
+    }
+  }
+}
+TEST(Map, FindManySweeps1) {
+  const int n = 4095;
+  s21::map<int, int, CountingLess> s21_map;
+  for (int i = 0; i < n; ++i)
+    s21_map[i * 2] = i;
+  std::vector<int> probes;
+  for (int i = 0; i < 2 * n; ++i)
+    probes.push_back(i);
+  CountingLess::calls = 0;
+  auto contained = s21_map.contains_many(probes);
+  double per_probe = double(CountingLess::calls) / (2 * n);
+  EXPECT_LT(per_probe, 4.0);
+  for (int i = 0; i < 2 * n; ++i)
+    EXPECT_EQ(contained[i], i % 2 == 0);
+}
+TEST(Set, FindManyTransparent1) {
+  s21::set<std::string, std::less<>> s21_set({"ant", "bee", "cat", "dog"});
+  std::vector<std::string_view> probes = {"dog", "cow", "ant", "eel", "bee"};
+  std::vector<bool> expected = {true, false, true, false, true};
+  EXPECT_EQ(s21_set.contains_many(probes), expected);
+  EXPECT_EQ(*s21_set.find_many(probes)[0], "dog");
+}
+template <typename Container, typename Range, typename = void>
+struct has_find_many : std::false_type {};
+template <typename Container, typename Range>
+struct has_find_many<Container, Range,
+                     std::void_t<decltype(std::declval<const Container &>()
+                                              .find_many(std::declval<
+                                                         const Range &>()))>>
+    : std::true_type {};
+TEST(Set, FindManyKeyType1) {
+  using views = std::vector<std::string_view>;
+  EXPECT_TRUE((has_find_many<s21::set<std::string>,
+                             std::vector<std::string>>::value));
+  EXPECT_FALSE((has_find_many<s21::set<std::string>, views>::value));
+  EXPECT_FALSE((has_find_many<s21::map<std::string, int>, views>::value));
+  EXPECT_FALSE(
+      (has_find_many<s21::split_map<std::string, int>, views>::value));
+  EXPECT_TRUE(
+      (has_find_many<s21::set<std::string, std::less<>>, views>::value));
+}
+TEST(SplitMap, FindMany1) {
+  s21::split_map<int, std::string> s21_map({{3, "c"}, {1, "a"}, {2, "b"}});
+  auto found = s21_map.find_many(std::vector<int>{2, 4, 1});
+  EXPECT_EQ((*found[0]).second, "b");
+  EXPECT_TRUE(found[1] == s21_map.end());
+  EXPECT_EQ((*found[2]).second, "a");
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -2,12 +2,17 @@
 #define S21_MAP_H_
 
 #include "RBTree.h"
+#include "Reclaimer.h"
 #include <functional>
+#include <memory_resource>
+#include <optional>
+#include <tuple>
 #include <vector>
 
 namespace s21 {
 
-template <typename Key, typename T, typename Compare = std::less<Key>>
+template <typename Key, typename T, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, T>>>
 class map {
 public:
   // Typedefs
@@ -17,35 +22,63 @@ public:
   using value_type = std::pair<const key_type, mapped_type>;
   using reference = value_type &;
   using const_reference = const value_type &;
+  using allocator_type = Allocator;
   using iterator =
-      typename RBTree<key_type, value_type, compare_type>::iterator;
+      typename RBTree<key_type, value_type, SelectFirst<value_type>,
+                      compare_type, allocator_type>::iterator;
   using const_iterator =
-      typename RBTree<key_type, value_type, compare_type>::const_iterator;
+      typename RBTree<key_type, value_type, SelectFirst<value_type>,
+                      compare_type, allocator_type>::const_iterator;
   using size_type = size_t;
-  using node_type = typename RBTree<key_type, value_type, compare_type>::Node;
+  // an upsert of the key, or its erasure when no mapped value is given
+  using batch_entry = std::pair<key_type, std::optional<mapped_type>>;
+  using node_type =
+      typename RBTree<key_type, value_type, SelectFirst<value_type>,
+                      compare_type, allocator_type>::Node;
+  using detached_type =
+      typename RBTree<key_type, value_type, SelectFirst<value_type>,
+                      compare_type, allocator_type>::Detached;
+  using node_handle =
+      typename RBTree<key_type, value_type, SelectFirst<value_type>,
+                      compare_type, allocator_type>::NodeHandle;
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_handle node;
+  };
 
   // Map Member functions
   map() {}
-  explicit map(std::initializer_list<value_type> const &items) {
-    for (auto i : items) {
-      insert(i);
-    }
+  explicit map(const allocator_type &alloc) : tree_(alloc) {}
+  explicit map(std::initializer_list<value_type> const &items,
+               const allocator_type &alloc = allocator_type())
+      : tree_(alloc) {
+    tree_.insert_range(items.begin(), items.end());
   }
-  map(const map &m) {
-    for (auto i : m) {
-      insert(i);
-    }
+  // a sorted forward range is built in linear time, see assign_sorted
+  template <typename InputIt, typename = typename std::iterator_traits<
+                                  InputIt>::iterator_category>
+  map(InputIt first, InputIt last,
+      const allocator_type &alloc = allocator_type())
+      : tree_(alloc) {
+    tree_.insert_range(first, last);
   }
+  map(const map &m) : tree_(m.tree_) {}
+  map(const map &m, const allocator_type &alloc) : tree_(m.tree_, alloc) {}
   map(map &&m) noexcept : tree_(std::move(m.tree_)) {}
-  map &operator=(const map &m) noexcept {
-    tree_ = std::copy(m.tree_);
+  map(map &&m, const allocator_type &alloc)
+      : tree_(std::move(m.tree_), alloc) {}
+  map &operator=(const map &m) {
+    tree_ = m.tree_;
     return *this;
   }
-  map &operator=(map &&m) noexcept {
+  map &operator=(map &&m) noexcept(
+      std::is_nothrow_move_assignable<decltype(tree_)>::value) {
     tree_ = std::move(m.tree_);
     return *this;
   }
   ~map() {}
+  allocator_type get_allocator() const { return tree_.get_allocator(); }
 
   // Map Element access
   mapped_type &at(const key_type &key) {
@@ -55,13 +88,36 @@ public:
     }
     return (*i).second;
   }
-  mapped_type &operator[](const key_type &key) noexcept {
+  // With a transparent Compare, at() and operator[] take anything the
+  // comparator orders against key_type; operator[] builds a key_type from
+  // it only when it has to insert.
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  mapped_type &at(const K &key) {
     auto i = iterator(tree_.find(key));
     if (i == end()) {
-      i = insert(key, mapped_type()).first;
+      throw std::out_of_range("map::at");
     }
     return (*i).second;
   }
+  // one descent finds the element or the place for a default one
+  mapped_type &operator[](const key_type &key) {
+    return (*try_emplace(key).first).second;
+  }
+  mapped_type &operator[](key_type &&key) {
+    return (*try_emplace(std::move(key)).first).second;
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  mapped_type &operator[](K &&key) {
+    auto pos = tree_.locate(key);
+    if (pos.found) {
+      return (*iterator(pos.node)).second;
+    }
+    return (*iterator(tree_.emplace_at(
+                pos, std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)),
+                std::forward_as_tuple())))
+        .second;
+  }
 
   // Map Iterators
   iterator begin() const noexcept { return tree_.begin(); }
@@ -71,71 +127,402 @@ public:
   bool empty() const noexcept { return tree_.size() == 0; }
   size_type size() const noexcept { return tree_.size(); }
   size_type max_size() const noexcept { return tree_.max_size(); }
+  void reserve(size_type n) { tree_.reserve(n); }
+  void shrink_to_fit() { tree_.shrink_to_fit(); }
+  size_type capacity() const noexcept { return tree_.capacity(); }
+  // relocates the elements into one contiguous block in the given order,
+  // which makes iteration and lookups cache friendly after heavy churn;
+  // invalidates all iterators
+  void compact(CompactOrder order = CompactOrder::IN_ORDER) {
+    tree_.compact(order);
+  }
+  // compacts from erase() once churn insertions and erasures have piled up
+  // since the last compaction, so erase() then invalidates all iterators;
+  // 0 turns it off (the default)
+  void set_auto_compact(size_type churn,
+                        CompactOrder order = CompactOrder::IN_ORDER) noexcept {
+    tree_.set_auto_compact(churn, order);
+  }
+  MemoryUsage memory_usage() const noexcept { return tree_.memory_usage(); }
+  // caps the bytes of node storage; see MemoryBudget for what happens when
+  // an insertion would cross the limit
+  void set_memory_budget(size_type bytes,
+                         std::function<bool(size_type)> on_exceeded = {}) {
+    tree_.set_memory_budget(
+        std::make_shared<MemoryBudget>(bytes, std::move(on_exceeded)));
+  }
+  void clear_memory_budget() { tree_.set_memory_budget(nullptr); }
 
   // Map Modifiers
   void clear() noexcept { tree_.delete_tree(); }
-  std::pair<iterator, bool> insert(const value_type &value) noexcept {
-    std::pair<iterator, bool> res;
-    node_type *x = tree_.insert(value.first, value);
-    res.second = true;
-    if (!x) {
-      x = tree_.find(value.first);
-      res.second = false;
-    } else {
-      tree_.fix(x);
+  // Replaces the contents with a range sorted by key in O(n) and a single
+  // allocation. With checked, repeated keys keep their first element and
+  // an unsorted range throws std::invalid_argument, leaving the container
+  // unchanged; without it the range must be strictly increasing.
+  template <typename InputIt>
+  void assign_sorted(InputIt first, InputIt last, bool checked = true) {
+    tree_.assign_sorted(first, last, checked);
+  }
+  // empties the container in O(1) and returns the old elements; they are
+  // freed when the result is destroyed or piecewise by its reclaim(n)
+  detached_type detach() noexcept { return tree_.detach(); }
+  // clear() whose freeing happens on the reclaimer's thread
+  void clear_deferred(Reclaimer &reclaimer) { reclaimer.post(tree_.detach()); }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    auto res = tree_.try_emplace(value.first, value);
+    return {iterator(res.first), res.second};
+  }
+  std::pair<iterator, bool> insert(value_type &&value) {
+    auto res = tree_.try_emplace(value.first, std::move(value));
+    return {iterator(res.first), res.second};
+  }
+  // the element is constructed in its node from args, nothing is copied
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args &&...args) {
+    auto res = tree_.emplace(std::forward<Args>(args)...);
+    return {iterator(res.first), res.second};
+  }
+  // a hint naming the element that follows the new one, or end() when
+  // appending, saves the descent
+  template <typename... Args>
+  iterator emplace_hint(iterator hint, Args &&...args) {
+    auto res = tree_.emplace_hint(hint, std::forward<Args>(args)...);
+    return iterator(res.first);
+  }
+  iterator insert(iterator hint, const value_type &value) {
+    auto pos = tree_.locate(hint, value.first);
+    if (pos.found) {
+      return iterator(pos.node);
     }
-    res.first = iterator(x);
-    return res;
+    return iterator(tree_.emplace_at(pos, value));
+  }
+  // the mapped value is built from args only if key is not present yet
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type &key, Args &&...args) {
+    auto res = tree_.try_emplace(
+        key, std::piecewise_construct, std::forward_as_tuple(key),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+    return {iterator(res.first), res.second};
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(key_type &&key, Args &&...args) {
+    auto res = tree_.try_emplace(
+        key, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+    return {iterator(res.first), res.second};
   }
   std::pair<iterator, bool> insert(const key_type &key,
-                                   const mapped_type &obj) noexcept {
-    std::pair<iterator, bool> res;
-    node_type *x = tree_.insert(key, value_type(key, obj));
-    res.second = true;
-    if (!x) {
-      x = tree_.find(key);
-      res.second = false;
-    } else {
-      tree_.fix(x);
-    }
-    res.first = iterator(x);
-    return res;
+                                   const mapped_type &obj) {
+    return try_emplace(key, obj);
   }
-  std::pair<iterator, bool> insert_or_assign(const key_type &key,
-                                             const mapped_type &obj) noexcept {
-    std::pair<iterator, bool> res;
-    node_type *x = tree_.insert(key, value_type(key, obj));
-    res.second = true;
-    if (!x) {
-      x = tree_.find(key);
-      operator[](key) = obj;
-      res.second = false;
-    } else {
-      tree_.fix(x);
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+    auto pos = tree_.locate(key);
+    if (pos.found) {
+      auto i = iterator(pos.node);
+      (*i).second = std::forward<M>(obj);
+      return {i, false};
     }
-    res.first = iterator(x);
-    return res;
+    return {iterator(tree_.emplace_at(pos, key, std::forward<M>(obj))), true};
   }
+  // inserts in one ascending sweep; results follow the argument order
   template <typename... Args>
-  std::vector<std::pair<iterator, bool>>
-  insert_many(Args &&...args) noexcept {
-    std::vector<std::pair<iterator, bool>> res;
-    for (const auto &arg : {args...}) {
-      res.push_back(insert(arg));
+  std::vector<std::pair<iterator, bool>> insert_many(Args &&...args) {
+    std::vector<value_type> values;
+    values.reserve(sizeof...(Args));
+    (values.emplace_back(std::forward<Args>(args)), ...);
+    std::vector<std::pair<iterator, bool>> res(values.size());
+    tree_.sweep(
+        values.size(),
+        [&](size_type i) -> const key_type & { return values[i].first; },
+        [&](size_type i, const auto &pos) {
+          res[i] = pos.found ? std::make_pair(iterator(pos.node), false)
+                             : std::make_pair(iterator(tree_.emplace_at(
+                                                  pos, std::move(values[i]))),
+                                              true);
+          return res[i].first;
+        });
+    return res;
+  }
+  // Applies a range of batch_entry as if entry by entry in range order,
+  // but in one ascending sweep over the tree; mapped values are moved out
+  // of an rvalue range. Result i tells whether entry i added or removed a
+  // key. A throwing entry leaves the ones before it in sorted order applied.
+  template <typename Range> std::vector<bool> apply_batch(Range &&batch) {
+    // const entries are copied from even in an rvalue range
+    using entry_type = std::remove_reference_t<decltype(*std::begin(batch))>;
+    using mapped_ref =
+        std::conditional_t<std::is_lvalue_reference<Range>::value ||
+                               std::is_const<entry_type>::value,
+                           const mapped_type &, mapped_type &&>;
+    std::vector<decltype(&*std::begin(batch))> entries;
+    for (auto &entry : batch) {
+      entries.push_back(&entry);
     }
+    std::vector<bool> res(entries.size());
+    tree_.sweep(
+        entries.size(),
+        [&](size_type i) -> const key_type & { return entries[i]->first; },
+        [&](size_type i, const auto &pos) {
+          auto &mapped = entries[i]->second;
+          if (!mapped) {
+            res[i] = pos.found;
+            if (pos.found)
+              tree_.delete_node(pos.node);
+            return end();
+          }
+          if (pos.found) {
+            iterator it(pos.node);
+            (*it).second = static_cast<mapped_ref>(*mapped);
+            return it;
+          }
+          res[i] = true;
+          return iterator(tree_.emplace_at(pos, entries[i]->first,
+                                           static_cast<mapped_ref>(*mapped)));
+        });
+    tree_.auto_compact();
     return res;
   }
-  void erase(iterator pos) noexcept { tree_.delete_node(pos); }
+  void erase(iterator pos) noexcept {
+    tree_.delete_node(pos);
+    tree_.auto_compact();
+  }
+  size_type erase(const key_type &key) noexcept { return erase_key(key); }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type erase(const K &key) noexcept {
+    return erase_key(key);
+  }
+  // Range erasures cut the tree instead of erasing element by element:
+  // O(log n) plus destroying the elements.
+  void erase(iterator first, iterator last) noexcept {
+    tree_.erase(first, last);
+    tree_.auto_compact();
+  }
+  // erases the elements with keys less than key
+  void erase_before(const key_type &key) noexcept {
+    tree_.erase_before(key);
+    tree_.auto_compact();
+  }
+  // erases the elements with keys greater than key
+  void erase_after(const key_type &key) noexcept {
+    tree_.erase_after(key);
+    tree_.auto_compact();
+  }
+  // Returns the elements with keys not less than key, which leave this
+  // map. O(log n) relinking plus a walk over the smaller part for the
+  // sizes; nothing is copied.
+  map split(const key_type &key) {
+    map right(get_allocator());
+    tree_.split(key, right.tree_);
+    return right;
+  }
+  // Takes every element of other in O(log n). The keys of other must all
+  // be greater than those here or all less, else std::invalid_argument.
+  void join(map &other) { tree_.join(other.tree_); }
+  // In-place set algebra by key: other's elements are spliced in or
+  // freed, leaving other empty. O(m log(n/m + 1)) work for sizes m <= n,
+  // spread over threads for large maps; Compare must be safe to call
+  // concurrently. For keys in both, the mapped value here is kept, or
+  // replaced with combine(mine, theirs).
+  void unite(map &other) { tree_.unite(other.tree_, keep_mine()); }
+  template <typename Combine> void unite(map &other, Combine combine) {
+    tree_.unite(other.tree_, combine_mapped<Combine>{combine});
+  }
+  void intersect(map &other) { tree_.intersect(other.tree_, keep_mine()); }
+  template <typename Combine> void intersect(map &other, Combine combine) {
+    tree_.intersect(other.tree_, combine_mapped<Combine>{combine});
+  }
+  void subtract(map &other) { tree_.subtract(other.tree_); }
+  // Moves in the elements of every map in the range others in one k-way
+  // pass and rebuilds the tree in linear time; see RBTree::merge_all. For
+  // keys seen more than once the first mapped value is kept, or each later
+  // one is folded in with combine(mine, theirs), in range order with this
+  // map first.
+  template <typename Range> void merge_all(Range &others) {
+    tree_.merge_all(trees_of(others), keep_mine());
+  }
+  template <typename Range, typename Combine>
+  void merge_all(Range &others, Combine combine) {
+    tree_.merge_all(trees_of(others), combine_mapped<Combine>{combine});
+  }
   void swap(map &other) noexcept { tree_.swap(other.tree_); }
-  void merge(map &other) noexcept { tree_.merge(other.tree_); }
+  void merge(map &other) { tree_.merge(other.tree_); }
+  // the element leaves with its node; nothing is copied or freed
+  node_handle extract(iterator pos) { return tree_.extract(pos); }
+  node_handle extract(const key_type &key) {
+    auto i = tree_.find(key);
+    return i == tree_.end() ? node_handle() : tree_.extract(i);
+  }
+  // when the key is present the node stays in the returned handle
+  insert_return_type insert(node_handle &&node) {
+    auto res = tree_.insert(node);
+    return {res.first ? iterator(res.first) : end(), res.second,
+            std::move(node)};
+  }
 
   // Map Lookup
+  // Each lookup also has an overload for any K when Compare is transparent
+  // (std::less<> say), so a std::string_view probes a map keyed by
+  // std::string without building a temporary key.
+  iterator find(const key_type &key) const noexcept { return tree_.find(key); }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator find(const K &key) const noexcept {
+    return tree_.find(key);
+  }
   bool contains(const key_type &key) const noexcept {
-    return iterator(tree_.find(key)) != end();
+    return find(key) != end();
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  bool contains(const K &key) const noexcept {
+    return find(key) != end();
+  }
+  size_type count(const key_type &key) const noexcept {
+    return tree_.count(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type count(const K &key) const noexcept {
+    return tree_.count(key);
+  }
+  iterator lower_bound(const key_type &key) const noexcept {
+    return tree_.lower_bound(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator lower_bound(const K &key) const noexcept {
+    return tree_.lower_bound(key);
+  }
+  iterator upper_bound(const key_type &key) const noexcept {
+    return tree_.upper_bound(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator upper_bound(const K &key) const noexcept {
+    return tree_.upper_bound(key);
+  }
+  std::pair<iterator, iterator> equal_range(const key_type &key) const
+      noexcept {
+    return tree_.equal_range(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  std::pair<iterator, iterator> equal_range(const K &key) const noexcept {
+    return tree_.equal_range(key);
+  }
+  // Looks up a range of keys in one ascending sweep rather than a descent
+  // from the root each; results follow the range order. With a
+  // transparent Compare the keys may be of any comparable type.
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<iterator> find_many(const Range &keys) const {
+    std::vector<decltype(&*std::begin(keys))> probes;
+    for (auto &key : keys) {
+      probes.push_back(&key);
+    }
+    return tree_.find_many(probes.size(), [&](size_type i) -> decltype(auto) {
+      return *probes[i];
+    });
+  }
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<bool> contains_many(const Range &keys) const {
+    std::vector<bool> res;
+    for (iterator i : find_many(keys)) {
+      res.push_back(i != end());
+    }
+    return res;
   }
 
 private:
-  RBTree<key_type, value_type, compare_type> tree_;
+  using tree_type = RBTree<key_type, value_type, SelectFirst<value_type>,
+                           compare_type, allocator_type>;
+
+  template <typename Range>
+  static std::vector<tree_type *> trees_of(Range &maps) {
+    std::vector<tree_type *> trees;
+    for (map &m : maps) {
+      trees.push_back(&m.tree_);
+    }
+    return trees;
+  }
+  template <typename K> size_type erase_key(const K &key) noexcept {
+    auto i = tree_.find(key);
+    if (i == end()) {
+      return 0;
+    }
+    erase(i);
+    return 1;
+  }
+  struct keep_mine {
+    void operator()(value_type &, value_type &) const noexcept {}
+  };
+  template <typename Combine> struct combine_mapped {
+    void operator()(value_type &mine, value_type &theirs) {
+      mine.second = combine(mine.second, theirs.second);
+    }
+    Combine &combine;
+  };
+  tree_type tree_;
 };
+
+// Merges a range of maps into a new one that takes the first map's
+// allocator; the maps in the range end up empty.
+template <typename Range> auto merge_all(Range &maps) {
+  using map_type = std::decay_t<decltype(*std::begin(maps))>;
+  if (std::begin(maps) == std::end(maps))
+    return map_type();
+  map_type res(std::move(*std::begin(maps)));
+  res.merge_all(maps);
+  return res;
+}
+template <typename Range, typename Combine>
+auto merge_all(Range &maps, Combine combine) {
+  using map_type = std::decay_t<decltype(*std::begin(maps))>;
+  if (std::begin(maps) == std::end(maps))
+    return map_type();
+  map_type res(std::move(*std::begin(maps)));
+  res.merge_all(maps, combine);
+  return res;
+}
+
+// Set algebra on whole maps; pass arguments by std::move to avoid copies.
+template <typename Key, typename T, typename Compare, typename Allocator>
+map<Key, T, Compare, Allocator> set_union(map<Key, T, Compare, Allocator> a,
+                                          map<Key, T, Compare, Allocator> b) {
+  a.unite(b);
+  return a;
+}
+template <typename Key, typename T, typename Compare, typename Allocator,
+          typename Combine>
+map<Key, T, Compare, Allocator> set_union(map<Key, T, Compare, Allocator> a,
+                                          map<Key, T, Compare, Allocator> b,
+                                          Combine combine) {
+  a.unite(b, combine);
+  return a;
+}
+template <typename Key, typename T, typename Compare, typename Allocator>
+map<Key, T, Compare, Allocator>
+set_intersection(map<Key, T, Compare, Allocator> a,
+                 map<Key, T, Compare, Allocator> b) {
+  a.intersect(b);
+  return a;
+}
+template <typename Key, typename T, typename Compare, typename Allocator,
+          typename Combine>
+map<Key, T, Compare, Allocator>
+set_intersection(map<Key, T, Compare, Allocator> a,
+                 map<Key, T, Compare, Allocator> b, Combine combine) {
+  a.intersect(b, combine);
+  return a;
+}
+template <typename Key, typename T, typename Compare, typename Allocator>
+map<Key, T, Compare, Allocator>
+set_difference(map<Key, T, Compare, Allocator> a,
+               map<Key, T, Compare, Allocator> b) {
+  a.subtract(b);
+  return a;
+}
+
+namespace pmr {
+template <typename Key, typename T, typename Compare = std::less<Key>>
+using map = s21::map<Key, T, Compare,
+                     std::pmr::polymorphic_allocator<std::pair<const Key, T>>>;
+} // namespace pmr
 } // namespace s21
 #endif // S21_MAP_H_
\ No newline at end of file
@@ -2,46 +2,80 @@
 #define CPP2_S21_CONTAINERS_1_S21_CONTAINERS_S21_SET_H_
 
 #include "RBTree.h"
+#include "Reclaimer.h"
+#include <functional>
+#include <memory_resource>
+#include <vector>
 
 namespace s21 {
 
-template <typename T, typename Compare = std::less<T>> class set {
+template <typename T, typename Compare = std::less<T>,
+          typename Allocator = std::allocator<T>>
+class set {
 public:
   // Typedefs
   using key_type = T;
   using value_type = T;
   using compare_type = Compare;
   using reference = value_type &;
-  using const_reference = const reference;
+  using const_reference = const value_type &;
+  using allocator_type = Allocator;
   using iterator =
-      typename RBTree<key_type, value_type, compare_type>::iterator;
+      typename RBTree<key_type, value_type, Identity<value_type>,
+                      compare_type, allocator_type>::iterator;
   using const_iterator =
-      typename RBTree<key_type, value_type, compare_type>::const_iterator;
+      typename RBTree<key_type, value_type, Identity<value_type>,
+                      compare_type, allocator_type>::const_iterator;
   using size_type = size_t;
-  using node_type = typename RBTree<key_type, value_type, compare_type>::Node;
+  // a key to insert (true) or to erase (false)
+  using batch_entry = std::pair<key_type, bool>;
+  using node_type =
+      typename RBTree<key_type, value_type, Identity<value_type>,
+                      compare_type, allocator_type>::Node;
+  using detached_type =
+      typename RBTree<key_type, value_type, Identity<value_type>,
+                      compare_type, allocator_type>::Detached;
+  using node_handle =
+      typename RBTree<key_type, value_type, Identity<value_type>,
+                      compare_type, allocator_type>::NodeHandle;
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_handle node;
+  };
 
   // Member functions
   set() {}
-  explicit set(std::initializer_list<value_type> const &items) {
-    for (auto i : items) {
-      insert(i);
-    }
+  explicit set(const allocator_type &alloc) : tree_(alloc) {}
+  explicit set(std::initializer_list<value_type> const &items,
+               const allocator_type &alloc = allocator_type())
+      : tree_(alloc) {
+    tree_.insert_range(items.begin(), items.end());
   }
-  set(const set &s) {
-    for (auto i : s) {
-      insert(i);
-    }
+  // a sorted forward range is built in linear time, see assign_sorted
+  template <typename InputIt, typename = typename std::iterator_traits<
+                                  InputIt>::iterator_category>
+  set(InputIt first, InputIt last,
+      const allocator_type &alloc = allocator_type())
+      : tree_(alloc) {
+    tree_.insert_range(first, last);
   }
+  set(const set &s) : tree_(s.tree_) {}
+  set(const set &s, const allocator_type &alloc) : tree_(s.tree_, alloc) {}
   set(set &&s) noexcept : tree_(std::move(s.tree_)) {}
-  set &operator=(const set &s) noexcept {
-    tree_ = std::copy(s.tree_);
+  set(set &&s, const allocator_type &alloc)
+      : tree_(std::move(s.tree_), alloc) {}
+  set &operator=(const set &s) {
+    tree_ = s.tree_;
     return *this;
   }
-  set &operator=(set &&s) noexcept {
+  set &operator=(set &&s) noexcept(
+      std::is_nothrow_move_assignable<decltype(tree_)>::value) {
     tree_ = std::move(s.tree_);
     return *this;
   }
   ~set() {}
+  allocator_type get_allocator() const { return tree_.get_allocator(); }
 
   // Iterators
   iterator begin() const noexcept { return tree_.begin(); }
@@ -51,46 +85,289 @@ public:
   bool empty() const noexcept { return tree_.size() == 0; }
   size_type size() const noexcept { return tree_.size(); }
   size_type max_size() const noexcept { return tree_.max_size(); }
+  void reserve(size_type n) { tree_.reserve(n); }
+  void shrink_to_fit() { tree_.shrink_to_fit(); }
+  size_type capacity() const noexcept { return tree_.capacity(); }
+  // relocates the elements into one contiguous block in the given order,
+  // which makes iteration and lookups cache friendly after heavy churn;
+  // invalidates all iterators
+  void compact(CompactOrder order = CompactOrder::IN_ORDER) {
+    tree_.compact(order);
+  }
+  // compacts from erase() once churn insertions and erasures have piled up
+  // since the last compaction, so erase() then invalidates all iterators;
+  // 0 turns it off (the default)
+  void set_auto_compact(size_type churn,
+                        CompactOrder order = CompactOrder::IN_ORDER) noexcept {
+    tree_.set_auto_compact(churn, order);
+  }
+  MemoryUsage memory_usage() const noexcept { return tree_.memory_usage(); }
+  // caps the bytes of node storage; see MemoryBudget for what happens when
+  // an insertion would cross the limit
+  void set_memory_budget(size_type bytes,
+                         std::function<bool(size_type)> on_exceeded = {}) {
+    tree_.set_memory_budget(
+        std::make_shared<MemoryBudget>(bytes, std::move(on_exceeded)));
+  }
+  void clear_memory_budget() { tree_.set_memory_budget(nullptr); }
 
   // Modifiers
   void clear() noexcept { tree_.delete_tree(); }
-  std::pair<iterator, bool> insert(const value_type &value) noexcept {
-    std::pair<iterator, bool> res;
-    node_type *x = tree_.insert(value, value);
-    res.second = true;
-    if (!x) {
-      x = tree_.find(value);
-      res.second = false;
-    } else {
-      tree_.fix(x);
+  // Replaces the contents with a range sorted by key in O(n) and a single
+  // allocation. With checked, repeated keys keep their first element and
+  // an unsorted range throws std::invalid_argument, leaving the container
+  // unchanged; without it the range must be strictly increasing.
+  template <typename InputIt>
+  void assign_sorted(InputIt first, InputIt last, bool checked = true) {
+    tree_.assign_sorted(first, last, checked);
+  }
+  // empties the container in O(1) and returns the old elements; they are
+  // freed when the result is destroyed or piecewise by its reclaim(n)
+  detached_type detach() noexcept { return tree_.detach(); }
+  // clear() whose freeing happens on the reclaimer's thread
+  void clear_deferred(Reclaimer &reclaimer) { reclaimer.post(tree_.detach()); }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    auto res = tree_.try_emplace(value, value);
+    return {iterator(res.first), res.second};
+  }
+  std::pair<iterator, bool> insert(value_type &&value) {
+    auto res = tree_.try_emplace(value, std::move(value));
+    return {iterator(res.first), res.second};
+  }
+  // the element is constructed in its node from args, nothing is copied
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args &&...args) {
+    auto res = tree_.emplace(std::forward<Args>(args)...);
+    return {iterator(res.first), res.second};
+  }
+  // a hint naming the element that follows the new one, or end() when
+  // appending, saves the descent
+  template <typename... Args>
+  iterator emplace_hint(iterator hint, Args &&...args) {
+    auto res = tree_.emplace_hint(hint, std::forward<Args>(args)...);
+    return iterator(res.first);
+  }
+  iterator insert(iterator hint, const value_type &value) {
+    auto pos = tree_.locate(hint, value);
+    if (pos.found) {
+      return iterator(pos.node);
     }
-    res.first = iterator(x);
-    return res;
+    return iterator(tree_.emplace_at(pos, value));
   }
 
-  // vector<std::pair<iterator, bool>> insert_many(Args&&... args);
+  // inserts in one ascending sweep; results follow the argument order
   template <typename... Args>
-  std::vector<std::pair<iterator, bool>> insert_many(Args &&...args) noexcept {
-    std::vector<std::pair<iterator, bool>> res;
-    for (const auto &arg : {args...}) {
-      res.push_back(insert(arg));
+  std::vector<std::pair<iterator, bool>> insert_many(Args &&...args) {
+    std::vector<value_type> values;
+    values.reserve(sizeof...(Args));
+    (values.emplace_back(std::forward<Args>(args)), ...);
+    std::vector<std::pair<iterator, bool>> res(values.size());
+    tree_.sweep(
+        values.size(),
+        [&](size_type i) -> const key_type & { return values[i]; },
+        [&](size_type i, const auto &pos) {
+          res[i] = pos.found ? std::make_pair(iterator(pos.node), false)
+                             : std::make_pair(iterator(tree_.emplace_at(
+                                                  pos, std::move(values[i]))),
+                                              true);
+          return res[i].first;
+        });
+    return res;
+  }
+  // Applies a range of batch_entry as if entry by entry in range order,
+  // but in one ascending sweep over the tree. Result i tells whether entry
+  // i added or removed a key. A throwing entry leaves the ones before it in
+  // sorted order applied.
+  template <typename Range> std::vector<bool> apply_batch(const Range &batch) {
+    std::vector<const batch_entry *> entries;
+    for (const batch_entry &entry : batch) {
+      entries.push_back(&entry);
     }
+    std::vector<bool> res(entries.size());
+    tree_.sweep(
+        entries.size(),
+        [&](size_type i) -> const key_type & { return entries[i]->first; },
+        [&](size_type i, const auto &pos) {
+          res[i] = pos.found != entries[i]->second;
+          if (!entries[i]->second) {
+            if (pos.found)
+              tree_.delete_node(pos.node);
+            return end();
+          }
+          return pos.found ? iterator(pos.node)
+                           : iterator(tree_.emplace_at(pos, entries[i]->first));
+        });
+    tree_.auto_compact();
     return res;
   }
-  void erase(iterator pos) noexcept { tree_.delete_node(pos); }
+  void erase(iterator pos) noexcept {
+    tree_.delete_node(pos);
+    tree_.auto_compact();
+  }
+  size_type erase(const key_type &key) noexcept { return erase_key(key); }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type erase(const K &key) noexcept {
+    return erase_key(key);
+  }
+  // Range erasures cut the tree instead of erasing element by element:
+  // O(log n) plus destroying the elements.
+  void erase(iterator first, iterator last) noexcept {
+    tree_.erase(first, last);
+    tree_.auto_compact();
+  }
+  // erases the elements with keys less than key
+  void erase_before(const key_type &key) noexcept {
+    tree_.erase_before(key);
+    tree_.auto_compact();
+  }
+  // erases the elements with keys greater than key
+  void erase_after(const key_type &key) noexcept {
+    tree_.erase_after(key);
+    tree_.auto_compact();
+  }
+  // Returns the elements with keys not less than key, which leave this
+  // set. O(log n) relinking plus a walk over the smaller part for the
+  // sizes; nothing is copied.
+  set split(const key_type &key) {
+    set right(get_allocator());
+    tree_.split(key, right.tree_);
+    return right;
+  }
+  // Takes every element of other in O(log n). The keys of other must all
+  // be greater than those here or all less, else std::invalid_argument.
+  void join(set &other) { tree_.join(other.tree_); }
+  // In-place set algebra: other's elements are spliced in or freed,
+  // leaving other empty. O(m log(n/m + 1)) work for sizes m <= n, spread
+  // over threads for large sets; Compare must be safe to call
+  // concurrently.
+  void unite(set &other) { tree_.unite(other.tree_, keep_mine()); }
+  void intersect(set &other) { tree_.intersect(other.tree_, keep_mine()); }
+  void subtract(set &other) { tree_.subtract(other.tree_); }
   void swap(set &other) noexcept { tree_.swap(other.tree_); }
-  void merge(set &other) noexcept { tree_.merge(other.tree_); }
+  void merge(set &other) { tree_.merge(other.tree_); }
+  // the element leaves with its node; nothing is copied or freed
+  node_handle extract(iterator pos) { return tree_.extract(pos); }
+  node_handle extract(const key_type &key) {
+    auto i = tree_.find(key);
+    return i == tree_.end() ? node_handle() : tree_.extract(i);
+  }
+  // when the key is present the node stays in the returned handle
+  insert_return_type insert(node_handle &&node) {
+    auto res = tree_.insert(node);
+    return {res.first ? iterator(res.first) : end(), res.second,
+            std::move(node)};
+  }
 
   // Lookup
+  // Each lookup also has an overload for any K when Compare is transparent,
+  // so probing needs no temporary key_type.
   iterator find(const key_type &key) const noexcept {
     return iterator(tree_.find(key));
   }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator find(const K &key) const noexcept {
+    return iterator(tree_.find(key));
+  }
   bool contains(const key_type &key) const noexcept {
     return find(key) != end();
   }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  bool contains(const K &key) const noexcept {
+    return find(key) != end();
+  }
+  size_type count(const key_type &key) const noexcept {
+    return tree_.count(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type count(const K &key) const noexcept {
+    return tree_.count(key);
+  }
+  iterator lower_bound(const key_type &key) const noexcept {
+    return tree_.lower_bound(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator lower_bound(const K &key) const noexcept {
+    return tree_.lower_bound(key);
+  }
+  iterator upper_bound(const key_type &key) const noexcept {
+    return tree_.upper_bound(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator upper_bound(const K &key) const noexcept {
+    return tree_.upper_bound(key);
+  }
+  std::pair<iterator, iterator> equal_range(const key_type &key) const
+      noexcept {
+    return tree_.equal_range(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  std::pair<iterator, iterator> equal_range(const K &key) const noexcept {
+    return tree_.equal_range(key);
+  }
+  // Looks up a range of keys in one ascending sweep rather than a descent
+  // from the root each; results follow the range order. With a
+  // transparent Compare the keys may be of any comparable type.
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<iterator> find_many(const Range &keys) const {
+    std::vector<decltype(&*std::begin(keys))> probes;
+    for (auto &key : keys) {
+      probes.push_back(&key);
+    }
+    return tree_.find_many(probes.size(), [&](size_type i) -> decltype(auto) {
+      return *probes[i];
+    });
+  }
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<bool> contains_many(const Range &keys) const {
+    std::vector<bool> res;
+    for (iterator i : find_many(keys)) {
+      res.push_back(i != end());
+    }
+    return res;
+  }
 
 private:
-  RBTree<key_type, value_type, compare_type> tree_;
+  template <typename K> size_type erase_key(const K &key) noexcept {
+    auto i = tree_.find(key);
+    if (i == end()) {
+      return 0;
+    }
+    erase(i);
+    return 1;
+  }
+  struct keep_mine {
+    void operator()(value_type &, value_type &) const noexcept {}
+  };
+  RBTree<key_type, value_type, Identity<value_type>, compare_type,
+         allocator_type>
+      tree_;
 };
+
+// Set algebra on whole sets; pass arguments by std::move to avoid copies.
+template <typename T, typename Compare, typename Allocator>
+set<T, Compare, Allocator> set_union(set<T, Compare, Allocator> a,
+                                     set<T, Compare, Allocator> b) {
+  a.unite(b);
+  return a;
+}
+template <typename T, typename Compare, typename Allocator>
+set<T, Compare, Allocator> set_intersection(set<T, Compare, Allocator> a,
+                                            set<T, Compare, Allocator> b) {
+  a.intersect(b);
+  return a;
+}
+template <typename T, typename Compare, typename Allocator>
+set<T, Compare, Allocator> set_difference(set<T, Compare, Allocator> a,
+                                          set<T, Compare, Allocator> b) {
+  a.subtract(b);
+  return a;
+}
+
+namespace pmr {
+template <typename T, typename Compare = std::less<T>>
+using set = s21::set<T, Compare, std::pmr::polymorphic_allocator<T>>;
+} // namespace pmr
 } // namespace s21
 #endif // CPP2_S21_CONTAINERS_1_S21_CONTAINERS_S21_SET_H_
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef S21_SMALL_MAP_H_
+#define S21_SMALL_MAP_H_
+
+#include "SmallTree.h"
+#include <functional>
+#include <memory_resource>
+#include <tuple>
+#include <vector>
+
+namespace s21 {
+
+// Map that keeps up to N elements inside the object and allocates nothing
+// until it grows past them. Growing past N moves the elements into a tree
+// and invalidates iterators and references, see SmallTree.
+template <typename Key, typename T, size_t N = 8,
+          typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, T>>>
+class small_map {
+  using storage_type =
+      SmallTree<Key, std::pair<const Key, T>,
+                SelectFirst<std::pair<const Key, T>>, Compare, N, Allocator>;
+
+public:
+  // Typedefs
+  using key_type = Key;
+  using mapped_type = T;
+  using compare_type = Compare;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+  using allocator_type = Allocator;
+  using iterator = typename storage_type::iterator;
+  using const_iterator = typename storage_type::const_iterator;
+  using size_type = size_t;
+
+  // Member functions
+  small_map() {}
+  explicit small_map(const allocator_type &alloc)
+      : storage_(compare_type(), alloc) {}
+  explicit small_map(std::initializer_list<value_type> const &items,
+                     const allocator_type &alloc = allocator_type())
+      : small_map(alloc) {
+    for (auto i : items) {
+      insert(i);
+    }
+  }
+  allocator_type get_allocator() const { return storage_.get_allocator(); }
+
+  // Element access
+  mapped_type &at(const key_type &key) {
+    auto i = storage_.find(key);
+    if (i == end()) {
+      throw std::out_of_range("small_map::at");
+    }
+    return (*i).second;
+  }
+  mapped_type &operator[](const key_type &key) {
+    return (*storage_
+                 .try_emplace(key, std::piecewise_construct,
+                              std::forward_as_tuple(key), std::tuple<>())
+                 .first)
+        .second;
+  }
+
+  // Iterators
+  iterator begin() const noexcept { return storage_.begin(); }
+  iterator end() const noexcept { return storage_.end(); }
+
+  // Capacity
+  bool empty() const noexcept { return storage_.size() == 0; }
+  size_type size() const noexcept { return storage_.size(); }
+  size_type max_size() const noexcept { return storage_.max_size(); }
+  // true while the elements live inside the object
+  bool is_inline() const noexcept { return storage_.is_inline(); }
+
+  // Modifiers
+  void clear() noexcept { storage_.clear(); }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    return storage_.insert(value);
+  }
+  std::pair<iterator, bool> insert(const key_type &key,
+                                   const mapped_type &obj) {
+    return storage_.try_emplace(key, key, obj);
+  }
+  std::pair<iterator, bool> insert_or_assign(const key_type &key,
+                                             const mapped_type &obj) {
+    auto res = storage_.try_emplace(key, key, obj);
+    if (!res.second) {
+      (*res.first).second = obj;
+    }
+    return res;
+  }
+  template <typename... Args>
+  std::vector<std::pair<iterator, bool>> insert_many(Args &&...args) {
+    std::vector<std::pair<iterator, bool>> res;
+    for (const auto &arg : {args...}) {
+      res.push_back(insert(arg));
+    }
+    return res;
+  }
+  void erase(iterator pos) noexcept { storage_.erase(pos); }
+  void swap(small_map &other) { storage_.swap(other.storage_); }
+  void merge(small_map &other) { storage_.merge(other.storage_); }
+
+  // Lookup
+  bool contains(const key_type &key) const noexcept {
+    return storage_.find(key) != end();
+  }
+
+private:
+  storage_type storage_;
+};
+
+namespace pmr {
+template <typename Key, typename T, size_t N = 8,
+          typename Compare = std::less<Key>>
+using small_map =
+    s21::small_map<Key, T, N, Compare,
+                   std::pmr::polymorphic_allocator<std::pair<const Key, T>>>;
+} // namespace pmr
+} // namespace s21
+#endif // S21_SMALL_MAP_H_
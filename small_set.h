@@ -0,0 +1,91 @@
+#ifndef S21_SMALL_SET_H_
+#define S21_SMALL_SET_H_
+
+#include "SmallTree.h"
+#include <functional>
+#include <memory_resource>
+#include <vector>
+
+namespace s21 {
+
+// Set that keeps up to N elements inside the object and allocates nothing
+// until it grows past them. Growing past N moves the elements into a tree
+// and invalidates iterators and references, see SmallTree.
+template <typename T, size_t N = 8, typename Compare = std::less<T>,
+          typename Allocator = std::allocator<T>>
+class small_set {
+  using storage_type =
+      SmallTree<T, T, Identity<T>, Compare, N, Allocator>;
+
+public:
+  // Typedefs
+  using key_type = T;
+  using value_type = T;
+  using compare_type = Compare;
+  using reference = value_type &;
+  using const_reference = const value_type &;
+  using allocator_type = Allocator;
+  using iterator = typename storage_type::iterator;
+  using const_iterator = typename storage_type::const_iterator;
+  using size_type = size_t;
+
+  // Member functions
+  small_set() {}
+  explicit small_set(const allocator_type &alloc)
+      : storage_(compare_type(), alloc) {}
+  explicit small_set(std::initializer_list<value_type> const &items,
+                     const allocator_type &alloc = allocator_type())
+      : small_set(alloc) {
+    for (auto i : items) {
+      insert(i);
+    }
+  }
+  allocator_type get_allocator() const { return storage_.get_allocator(); }
+
+  // Iterators
+  iterator begin() const noexcept { return storage_.begin(); }
+  iterator end() const noexcept { return storage_.end(); }
+
+  // Capacity
+  bool empty() const noexcept { return storage_.size() == 0; }
+  size_type size() const noexcept { return storage_.size(); }
+  size_type max_size() const noexcept { return storage_.max_size(); }
+  // true while the elements live inside the object
+  bool is_inline() const noexcept { return storage_.is_inline(); }
+
+  // Modifiers
+  void clear() noexcept { storage_.clear(); }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    return storage_.insert(value);
+  }
+  template <typename... Args>
+  std::vector<std::pair<iterator, bool>> insert_many(Args &&...args) {
+    std::vector<std::pair<iterator, bool>> res;
+    for (const auto &arg : {args...}) {
+      res.push_back(insert(arg));
+    }
+    return res;
+  }
+  void erase(iterator pos) noexcept { storage_.erase(pos); }
+  void swap(small_set &other) { storage_.swap(other.storage_); }
+  void merge(small_set &other) { storage_.merge(other.storage_); }
+
+  // Lookup
+  iterator find(const key_type &key) const noexcept {
+    return storage_.find(key);
+  }
+  bool contains(const key_type &key) const noexcept {
+    return find(key) != end();
+  }
+
+private:
+  storage_type storage_;
+};
+
+namespace pmr {
+template <typename T, size_t N = 8, typename Compare = std::less<T>>
+using small_set =
+    s21::small_set<T, N, Compare, std::pmr::polymorphic_allocator<T>>;
+} // namespace pmr
+} // namespace s21
+#endif // S21_SMALL_SET_H_
@@ -0,0 +1,434 @@
+#ifndef S21_SPLIT_MAP_H_
+#define S21_SPLIT_MAP_H_
+
+#include "NodePool.h"
+#include "RBTree.h"
+#include <functional>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+namespace s21 {
+
+// Ordered map for large mapped types. Tree nodes hold only the links, the
+// key and a pointer into a separate value arena, so a search touches the
+// keys alone. Dereferencing an iterator yields a pair of references
+// (key, mapped) instead of a reference to a stored pair.
+template <typename Key, typename T, typename Compare = std::less<Key>,
+          typename Allocator = std::allocator<std::pair<const Key, T>>>
+class split_map {
+  using alloc_traits = std::allocator_traits<Allocator>;
+  using entry_type = std::pair<const Key, T *>;
+  using entry_allocator =
+      typename alloc_traits::template rebind_alloc<entry_type>;
+  using mapped_allocator = typename alloc_traits::template rebind_alloc<T>;
+  using mapped_traits = std::allocator_traits<mapped_allocator>;
+  using tree_type = RBTree<Key, entry_type, SelectFirst<entry_type>, Compare,
+                           entry_allocator>;
+  using tree_iterator = typename tree_type::iterator;
+
+public:
+  template <bool Const> class basic_iterator {
+    friend split_map;
+
+  public:
+    using reference =
+        std::pair<const Key &, std::conditional_t<Const, const T &, T &>>;
+
+    basic_iterator() {}
+    reference operator*() const noexcept {
+      return reference((*it_).first, *(*it_).second);
+    }
+    basic_iterator &operator++() noexcept {
+      ++it_;
+      return *this;
+    }
+    basic_iterator &operator--() noexcept {
+      --it_;
+      return *this;
+    }
+    basic_iterator operator++(int) noexcept {
+      basic_iterator tmp = *this;
+      ++it_;
+      return tmp;
+    }
+    basic_iterator operator--(int) noexcept {
+      basic_iterator tmp = *this;
+      --it_;
+      return tmp;
+    }
+    bool operator==(const basic_iterator &other) const noexcept {
+      return it_ == other.it_;
+    }
+    bool operator!=(const basic_iterator &other) const noexcept {
+      return it_ != other.it_;
+    }
+
+  private:
+    explicit basic_iterator(tree_iterator it) : it_(it) {}
+    tree_iterator it_;
+  };
+
+  // Typedefs
+  using key_type = Key;
+  using mapped_type = T;
+  using compare_type = Compare;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using allocator_type = Allocator;
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+  using reference = typename iterator::reference;
+  using const_reference = typename const_iterator::reference;
+  using size_type = size_t;
+
+  // Member functions
+  split_map() {}
+  explicit split_map(const allocator_type &alloc)
+      : tree_(entry_allocator(alloc)), values_(alloc) {}
+  explicit split_map(std::initializer_list<value_type> const &items,
+                     const allocator_type &alloc = allocator_type())
+      : split_map(alloc) {
+    for (auto &i : items) {
+      insert(i);
+    }
+  }
+  split_map(const split_map &m)
+      : tree_(m.tree_),
+        values_(alloc_traits::select_on_container_copy_construction(
+            m.get_allocator())) {
+    clone_values();
+  }
+  split_map(split_map &&m) noexcept
+      : tree_(std::move(m.tree_)), values_(std::move(m.values_)) {}
+  // the copy is built aside and swapped in, so a throwing value copy
+  // leaves this map as it was
+  split_map &operator=(const split_map &m) {
+    if (this == &m)
+      return *this;
+    using propagate =
+        typename alloc_traits::propagate_on_container_copy_assignment;
+    split_map tmp(propagate::value ? m.get_allocator() : get_allocator());
+    tmp.tree_.set_memory_budget(values_.budget());
+    tmp.values_.set_budget(values_.budget());
+    tmp.tree_ = m.tree_;
+    tmp.clone_values();
+    clear();
+    tree_ = std::move(tmp.tree_);
+    values_.release();
+    values_.swap(tmp.values_, propagate());
+    return *this;
+  }
+  split_map &operator=(split_map &&m) {
+    if (this == &m)
+      return *this;
+    clear();
+    if (alloc_traits::propagate_on_container_move_assignment::value ||
+        get_allocator() == m.get_allocator()) {
+      values_.release();
+      values_.swap(
+          m.values_,
+          typename alloc_traits::propagate_on_container_move_assignment());
+      tree_ = std::move(m.tree_);
+    } else {
+      for (auto i = m.begin(); i != m.end(); ++i) {
+        insert((*i).first, std::move((*i).second));
+      }
+      m.clear();
+    }
+    return *this;
+  }
+  ~split_map() { clear(); }
+  allocator_type get_allocator() const { return values_.get_allocator(); }
+
+  // Element access
+  mapped_type &at(const key_type &key) {
+    auto i = tree_.find(key);
+    if (i == tree_.end()) {
+      throw std::out_of_range("split_map::at");
+    }
+    return *(*i).second;
+  }
+  mapped_type &operator[](const key_type &key) { return subscript(key); }
+  // with a transparent Compare, a key_type is built only on insertion
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  mapped_type &at(const K &key) {
+    auto i = tree_.find(key);
+    if (i == tree_.end()) {
+      throw std::out_of_range("split_map::at");
+    }
+    return *(*i).second;
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  mapped_type &operator[](const K &key) {
+    return subscript(key);
+  }
+
+  // Iterators
+  iterator begin() noexcept { return iterator(tree_.begin()); }
+  iterator end() noexcept { return iterator(tree_.end()); }
+  const_iterator begin() const noexcept {
+    return const_iterator(tree_.begin());
+  }
+  const_iterator end() const noexcept { return const_iterator(tree_.end()); }
+
+  // Capacity
+  bool empty() const noexcept { return tree_.size() == 0; }
+  size_type size() const noexcept { return tree_.size(); }
+  size_type max_size() const noexcept { return tree_.max_size(); }
+  void reserve(size_type n) {
+    tree_.reserve(n);
+    values_.reserve(n);
+  }
+  void shrink_to_fit() {
+    tree_.shrink_to_fit();
+    values_.shrink_to_fit();
+  }
+  MemoryUsage memory_usage() const noexcept {
+    MemoryUsage usage = tree_.memory_usage();
+    usage.payload_bytes = values_.size() * values_.slot_size();
+    usage.slab_overhead += values_.reserved_bytes() - usage.payload_bytes;
+    return usage;
+  }
+  // one budget covers both the tree nodes and the value arena
+  void set_memory_budget(size_type bytes,
+                         std::function<bool(size_type)> on_exceeded = {}) {
+    auto budget =
+        std::make_shared<MemoryBudget>(bytes, std::move(on_exceeded));
+    tree_.set_memory_budget(budget);
+    values_.set_budget(std::move(budget));
+  }
+  void clear_memory_budget() {
+    tree_.set_memory_budget(nullptr);
+    values_.set_budget(nullptr);
+  }
+
+  // Modifiers
+  void clear() noexcept {
+    for (auto i = tree_.begin(); i != tree_.end(); ++i) {
+      destroy_mapped((*i).second);
+    }
+    tree_.delete_tree();
+  }
+  std::pair<iterator, bool> insert(const value_type &value) {
+    return insert(value.first, value.second);
+  }
+  template <typename M>
+  std::pair<iterator, bool> insert(const key_type &key, M &&obj) {
+    auto pos = tree_.locate(key);
+    if (pos.found) {
+      return {iterator(tree_iterator(pos.node)), false};
+    }
+    return {emplace_at(pos, key, std::forward<M>(obj)), true};
+  }
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+    auto pos = tree_.locate(key);
+    if (pos.found) {
+      auto i = iterator(tree_iterator(pos.node));
+      (*i).second = std::forward<M>(obj);
+      return {i, false};
+    }
+    return {emplace_at(pos, key, std::forward<M>(obj)), true};
+  }
+  void erase(iterator pos) noexcept {
+    mapped_type *mapped = (*pos.it_).second;
+    tree_.delete_node(pos.it_);
+    destroy_mapped(mapped);
+  }
+  size_type erase(const key_type &key) noexcept { return erase_key(key); }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type erase(const K &key) noexcept {
+    return erase_key(key);
+  }
+  void swap(split_map &other) noexcept {
+    tree_.swap(other.tree_);
+    values_.swap(other.values_,
+                 typename alloc_traits::propagate_on_container_swap());
+  }
+
+  // Lookup
+  // Each lookup also has an overload for any K when Compare is transparent,
+  // so probing needs no temporary key_type.
+  iterator find(const key_type &key) noexcept {
+    return iterator(tree_.find(key));
+  }
+  const_iterator find(const key_type &key) const noexcept {
+    return const_iterator(tree_.find(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator find(const K &key) noexcept {
+    return iterator(tree_.find(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  const_iterator find(const K &key) const noexcept {
+    return const_iterator(tree_.find(key));
+  }
+  bool contains(const key_type &key) const noexcept {
+    return tree_.find(key) != tree_.end();
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  bool contains(const K &key) const noexcept {
+    return tree_.find(key) != tree_.end();
+  }
+  size_type count(const key_type &key) const noexcept {
+    return tree_.count(key);
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  size_type count(const K &key) const noexcept {
+    return tree_.count(key);
+  }
+  iterator lower_bound(const key_type &key) noexcept {
+    return iterator(tree_.lower_bound(key));
+  }
+  const_iterator lower_bound(const key_type &key) const noexcept {
+    return const_iterator(tree_.lower_bound(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator lower_bound(const K &key) noexcept {
+    return iterator(tree_.lower_bound(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  const_iterator lower_bound(const K &key) const noexcept {
+    return const_iterator(tree_.lower_bound(key));
+  }
+  iterator upper_bound(const key_type &key) noexcept {
+    return iterator(tree_.upper_bound(key));
+  }
+  const_iterator upper_bound(const key_type &key) const noexcept {
+    return const_iterator(tree_.upper_bound(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  iterator upper_bound(const K &key) noexcept {
+    return iterator(tree_.upper_bound(key));
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  const_iterator upper_bound(const K &key) const noexcept {
+    return const_iterator(tree_.upper_bound(key));
+  }
+  std::pair<iterator, iterator> equal_range(const key_type &key) noexcept {
+    auto range = tree_.equal_range(key);
+    return {iterator(range.first), iterator(range.second)};
+  }
+  std::pair<const_iterator, const_iterator>
+  equal_range(const key_type &key) const noexcept {
+    auto range = tree_.equal_range(key);
+    return {const_iterator(range.first), const_iterator(range.second)};
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  std::pair<iterator, iterator> equal_range(const K &key) noexcept {
+    auto range = tree_.equal_range(key);
+    return {iterator(range.first), iterator(range.second)};
+  }
+  template <typename K, typename = transparent_key_t<Compare, K>>
+  std::pair<const_iterator, const_iterator>
+  equal_range(const K &key) const noexcept {
+    auto range = tree_.equal_range(key);
+    return {const_iterator(range.first), const_iterator(range.second)};
+  }
+  // Looks up a range of keys in one ascending sweep rather than a descent
+  // from the root each; results follow the range order.
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<iterator> find_many(const Range &keys) {
+    return sweep_many<iterator>(keys);
+  }
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<const_iterator> find_many(const Range &keys) const {
+    return sweep_many<const_iterator>(keys);
+  }
+  template <typename Range,
+            typename = key_range_t<Compare, key_type, Range>>
+  std::vector<bool> contains_many(const Range &keys) const {
+    std::vector<bool> res;
+    for (const_iterator i : find_many(keys)) {
+      res.push_back(i != end());
+    }
+    return res;
+  }
+
+private:
+  template <typename It, typename Range>
+  std::vector<It> sweep_many(const Range &keys) const {
+    std::vector<decltype(&*std::begin(keys))> probes;
+    for (auto &key : keys) {
+      probes.push_back(&key);
+    }
+    std::vector<It> res;
+    for (tree_iterator i : tree_.find_many(
+             probes.size(),
+             [&](size_type i) -> decltype(auto) { return *probes[i]; })) {
+      res.push_back(It(i));
+    }
+    return res;
+  }
+  template <typename K> mapped_type &subscript(const K &key) {
+    auto pos = tree_.locate(key);
+    if (pos.found) {
+      return *(*tree_iterator(pos.node)).second;
+    }
+    return (*emplace_at(pos, key)).second;
+  }
+  template <typename K> size_type erase_key(const K &key) noexcept {
+    auto i = tree_.find(key);
+    if (i == tree_.end()) {
+      return 0;
+    }
+    erase(iterator(i));
+    return 1;
+  }
+  template <typename... Args> mapped_type *create_mapped(Args &&...args) {
+    mapped_type *mapped = values_.allocate();
+    mapped_allocator alloc(values_.get_allocator());
+    try {
+      mapped_traits::construct(alloc, mapped, std::forward<Args>(args)...);
+    } catch (...) {
+      values_.deallocate(mapped);
+      throw;
+    }
+    return mapped;
+  }
+  template <typename K, typename... Args>
+  iterator emplace_at(const typename tree_type::Position &pos, const K &key,
+                      Args &&...args) {
+    mapped_type *mapped = create_mapped(std::forward<Args>(args)...);
+    try {
+      return iterator(tree_iterator(tree_.emplace_at(pos, key, mapped)));
+    } catch (...) {
+      destroy_mapped(mapped);
+      throw;
+    }
+  }
+  void destroy_mapped(mapped_type *mapped) noexcept {
+    mapped_allocator alloc(values_.get_allocator());
+    mapped_traits::destroy(alloc, mapped);
+    values_.deallocate(mapped);
+  }
+  // tree_ was copied with the source's value pointers; give it its own values
+  void clone_values() {
+    auto i = tree_.begin();
+    try {
+      for (; i != tree_.end(); ++i) {
+        (*i).second = create_mapped(*(*i).second);
+      }
+    } catch (...) {
+      for (auto j = tree_.begin(); j != i; ++j) {
+        destroy_mapped((*j).second);
+      }
+      tree_.delete_tree();
+      throw;
+    }
+  }
+
+  tree_type tree_;
+  NodePool<mapped_type, allocator_type> values_;
+};
+
+namespace pmr {
+template <typename Key, typename T, typename Compare = std::less<Key>>
+using split_map =
+    s21::split_map<Key, T, Compare,
+                   std::pmr::polymorphic_allocator<std::pair<const Key, T>>>;
+} // namespace pmr
+} // namespace s21
+#endif // S21_SPLIT_MAP_H_